@@ -0,0 +1,218 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+// Generator of synthetic C and C++ headers for benchmarking the plugin.
+// The number of each kind of declaration and the nesting depth are given
+// on the command line, so that the cost can be measured as a function of
+// each of them.
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+namespace {
+
+    struct Parameters {
+        bool cxx = false;
+        unsigned int structs = 100;
+        unsigned int fields = 8;
+        unsigned int enums = 20;
+        unsigned int macros = 100;
+        unsigned int functions = 100;
+        unsigned int namespaces = 4;
+        unsigned int templates = 20;
+        unsigned int depth = 2;
+    }; // struct Parameters
+
+    void generate_enum (std::ostream& out, unsigned int j);
+    void generate_function (std::ostream& out, const Parameters& params, unsigned int j);
+    void generate_items (std::ostream& out, const Parameters& params, unsigned int ns);
+    void generate_macros (std::ostream& out, const Parameters& params);
+    void generate_struct (std::ostream& out, const Parameters& params, unsigned int j,
+                          unsigned int depth, const std::string& indent);
+    void generate_template (std::ostream& out, unsigned int j);
+    int pick (const Parameters& params, unsigned int j, unsigned int count);
+    unsigned int step (const Parameters& params);
+    void usage ();
+
+    void
+    generate_enum (std::ostream& out, unsigned int j)
+    {
+        out << "enum bench_enum_" << j << " {";
+        for (unsigned int k = 0; k < 8; k++)
+            out << (k ? ", " : " ") << "BENCH_ENUM_" << j << "_" << k;
+        out << " };\n";
+    } // generate_enum
+
+    void
+    generate_function (std::ostream& out, const Parameters& params, unsigned int j)
+    {
+        const char* tag = params.cxx ? "" : "struct ";
+        int type = pick (params, j, params.structs);
+        out << "int bench_function_" << j << " (";
+        if (type >= 0)
+            out << "const " << tag << "bench_struct_" << type << "* s, ";
+        out << "int n, double* values);\n";
+    } // generate_function
+
+    void
+    generate_items (std::ostream& out, const Parameters& params, unsigned int ns)
+    {
+        for (unsigned int j = ns; j < params.enums; j += step (params))
+            generate_enum (out, j);
+        for (unsigned int j = ns; j < params.structs; j += step (params))
+            generate_struct (out, params, j, params.depth, "");
+        for (unsigned int j = ns; j < params.functions; j += step (params))
+            generate_function (out, params, j);
+        if (params.cxx) {
+            for (unsigned int j = ns; j < params.templates; j += step (params))
+                generate_template (out, j);
+        } // if
+    } // generate_items
+
+    void
+    generate_macros (std::ostream& out, const Parameters& params)
+    {
+        for (unsigned int j = 0; j < params.macros; j++) {
+            if (j % 2)
+                out << "#define BENCH_MACRO_" << j << "(x, y) ((x) * " << j << " + (y))\n";
+            else
+                out << "#define BENCH_MACRO_" << j << " \"bench value " << j << "\"\n";
+        } // for
+    } // generate_macros
+
+    void
+    generate_struct (std::ostream& out, const Parameters& params, unsigned int j,
+                     unsigned int depth, const std::string& indent)
+    {
+        // Nested structs are members of the enclosing one, down to depth
+        const char* tag = params.cxx ? "" : "struct ";
+        out << indent << "struct bench_struct_" << j;
+        if (depth < params.depth)
+            out << "_level_" << params.depth - depth;
+        out << " {\n";
+
+        std::string inner = indent + "    ";
+        for (unsigned int k = 0; k < params.fields; k++) {
+            out << inner;
+            switch (k % 5) {
+            case 0: out << "int"; break;
+            case 1: out << "double"; break;
+            case 2: out << "const char*"; break;
+            case 3: out << "unsigned long"; break;
+            default:
+                if (pick (params, j + k * step (params), params.enums) >= 0)
+                    out << "enum bench_enum_"
+                        << pick (params, j + k * step (params), params.enums);
+                else
+                    out << "short";
+                break;
+            } // switch
+            out << " field_" << k << ";\n";
+        } // for
+
+        if (depth == params.depth && j >= step (params))
+            out << inner << tag << "bench_struct_" << j - step (params) << "* previous;\n";
+        if (depth > 0) {
+            generate_struct (out, params, j, depth - 1, inner);
+            out << inner << "char buffer[" << 16 * (depth + 1) << "];\n";
+        } // if
+        out << indent << "}";
+        if (depth < params.depth)
+            out << " nested_" << params.depth - depth;
+        out << ";\n";
+    } // generate_struct
+
+    void
+    generate_template (std::ostream& out, unsigned int j)
+    {
+        out << "template <typename T, int N> struct bench_template_" << j << " {\n"
+            << "    T values[N];\n"
+            << "    T get (int k) const { return values[k % N]; }\n"
+            << "    void set (int k, const T& value) { values[k % N] = value; }\n"
+            << "};\n"
+            << "typedef bench_template_" << j << "<int, " << j + 1 << "> bench_instance_" << j << ";\n"
+            << "extern bench_template_" << j << "<double, 4> bench_variable_" << j << ";\n";
+    } // generate_template
+
+    int
+    pick (const Parameters& params, unsigned int j, unsigned int count)
+    {
+        // One of count items in the same namespace as item j, or -1 if that
+        // namespace has none
+        unsigned int first = j % step (params);
+        if (first >= count)
+            return -1;
+        unsigned int in_namespace = (count - first + step (params) - 1) / step (params);
+        return first + step (params) * ((j / step (params)) % in_namespace);
+    } // pick
+
+    unsigned int
+    step (const Parameters& params)
+    {
+        // Items are spread over the namespaces round robin
+        return params.cxx && params.namespaces ? params.namespaces : 1;
+    } // step
+
+    void
+    usage ()
+    {
+        std::cerr << "Usage: generate [-x c|c++] [-s structs] [-f fields] [-e enums]\n"
+                  << "                [-m macros] [-F functions] [-n namespaces]\n"
+                  << "                [-t templates] [-d depth]\n";
+        std::exit (1);
+    } // usage
+
+} // namespace
+
+int
+main (int argc, char** argv)
+{
+    Parameters params;
+
+    int c;
+    while ((c = getopt (argc, argv, "x:s:f:e:m:F:n:t:d:h")) != -1) {
+        switch (c) {
+        case 'x':
+            if (!std::strcmp (optarg, "c"))
+                params.cxx = false;
+            else if (!std::strcmp (optarg, "c++"))
+                params.cxx = true;
+            else
+                usage ();
+            break;
+        case 's': params.structs = std::atoi (optarg); break;
+        case 'f': params.fields = std::atoi (optarg); break;
+        case 'e': params.enums = std::atoi (optarg); break;
+        case 'm': params.macros = std::atoi (optarg); break;
+        case 'F': params.functions = std::atoi (optarg); break;
+        case 'n': params.namespaces = std::atoi (optarg); break;
+        case 't': params.templates = std::atoi (optarg); break;
+        case 'd': params.depth = std::atoi (optarg); break;
+        default:
+            usage ();
+        } // switch
+    } // while
+
+    std::ostream& out = std::cout;
+    out << "/* Generated by treecreeper bench/generate */\n";
+    generate_macros (out, params);
+
+    if (!params.cxx || params.namespaces == 0) {
+        generate_items (out, params, 0);
+        return 0;
+    } // if
+
+    // Each namespace is nested depth levels deep
+    for (unsigned int ns = 0; ns < params.namespaces; ns++) {
+        out << "namespace bench_ns_" << ns << " {\n";
+        for (unsigned int level = 1; level <= params.depth; level++)
+            out << "namespace level_" << level << " {\n";
+        generate_items (out, params, ns);
+        for (unsigned int level = 0; level <= params.depth; level++)
+            out << "}\n";
+    } // for
+    return 0;
+} // main
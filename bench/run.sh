@@ -0,0 +1,89 @@
+#!/bin/sh
+# Benchmark harness: compiles generated headers with and without the plugin
+# and reports the cost of the plugin. Run by "make bench", which sets:
+#
+#   TARGET_GCC  compiler to run
+#   PLUGIN      path of treecreeper.so
+#   GENERATOR   path of the header generator
+#   OUTDIR      directory for headers, dumps and logs
+#   SIZES       scale factors of the generated headers
+#   LANGUAGES   languages to generate (c and c++)
+#   GENERATE    extra generator options, e.g. "-d 4 -n 16"
+#   ARGS        extra plugin arguments, e.g. "format=cbor strings=table"
+#   TIME        GNU time, which measures peak RSS (default /usr/bin/time)
+
+set -e
+
+: "${TARGET_GCC:=gcc}"
+: "${SIZES:=1 4 16}"
+: "${LANGUAGES:=c c++}"
+: "${OUTDIR:=.}"
+: "${TIME:=/usr/bin/time}"
+
+if [ -z "$PLUGIN" ] || [ -z "$GENERATOR" ]; then
+    echo "run.sh: PLUGIN and GENERATOR must be set" >&2
+    exit 1
+fi
+if ! "$TIME" -f '%e %M' -o /dev/null true 2> /dev/null; then
+    echo "run.sh: GNU time is needed to measure peak RSS (set TIME)" >&2
+    exit 1
+fi
+
+plugin_args=
+for arg in $ARGS; do
+    plugin_args="$plugin_args -fplugin-arg-treecreeper-$arg"
+done
+
+mkdir -p "$OUTDIR"
+
+# Time and peak RSS (KiB) of a command, written to the file in $1
+measure () {
+    result=$1
+    shift
+    "$TIME" -f '%e %M' -o "$result" "$@"
+}
+
+printf '%-4s %5s %9s %8s %8s %8s %10s %10s %12s %9s %11s\n' \
+    lang scale lines base_s plugin_s added_s base_kib plugin_kib output_bytes \
+    nodes nodes_per_s
+
+for lang in $LANGUAGES; do
+    case $lang in
+        c) suffix=h ;;
+        c++) suffix=hh ;;
+        *) echo "run.sh: unknown language $lang" >&2; exit 1 ;;
+    esac
+
+    for scale in $SIZES; do
+        base=$OUTDIR/bench-$lang-$scale
+        header=$base.$suffix
+        "$GENERATOR" -x "$lang" -s $((100 * scale)) -e $((20 * scale)) \
+            -m $((100 * scale)) -F $((100 * scale)) -t $((20 * scale)) \
+            $GENERATE > "$header"
+
+        measure "$base.base.time" \
+            "$TARGET_GCC" -x "$lang" -S -o /dev/null "$header"
+        measure "$base.plugin.time" \
+            "$TARGET_GCC" -x "$lang" -S -fplugin="$PLUGIN" \
+                -fplugin-arg-treecreeper-output="$base.json" \
+                -fplugin-arg-treecreeper-verbose=1 $plugin_args \
+                "$header" 2> "$base.log"
+
+        lines=$(wc -l < "$header")
+        bytes=$(wc -c < "$base.json")
+        nodes=$(sed -n 's/^treecreeper: Wrote \([0-9]*\) nodes$/\1/p' "$base.log")
+        read -r base_s base_rss < "$base.base.time"
+        read -r plugin_s plugin_rss < "$base.plugin.time"
+
+        awk -v lang="$lang" -v scale="$scale" -v lines="$lines" \
+            -v base_s="$base_s" -v plugin_s="$plugin_s" \
+            -v base_rss="$base_rss" -v plugin_rss="$plugin_rss" \
+            -v bytes="$bytes" -v nodes="${nodes:-0}" 'BEGIN {
+                added = plugin_s - base_s
+                rate = added > 0 ? nodes / added : 0
+                printf "%-4s %5d %9d %8.2f %8.2f %8.2f %10d %10d %12d %9d %11.0f\n",
+                    lang, scale, lines, base_s, plugin_s, added, base_rss, plugin_rss,
+                    bytes, nodes, rate
+            }'
+    done
+done
@@ -0,0 +1,283 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+// Microbenchmark of the output streams. Each case writes one kind of
+// value until the stream holds the requested number of bytes, and reports
+// the throughput and the number of heap allocations per value written.
+// Pretty mode is the default layout of the dumps, compact mode is records
+// mode, which writes no whitespace.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include <unistd.h>
+
+#include "output_stream.h"
+
+using namespace treecreeper;
+
+// Allocations are counted by replacing the global allocation functions
+static std::uint64_t allocations = 0;
+
+void* operator new (std::size_t size)
+{
+    allocations++;
+    if (void* p = std::malloc (size ? size : 1))
+        return p;
+    throw std::bad_alloc ();
+} // operator new
+
+void* operator new[] (std::size_t size)
+{
+    return operator new (size);
+} // operator new[]
+
+void operator delete (void* p) noexcept
+{
+    std::free (p);
+} // operator delete
+
+void operator delete[] (void* p) noexcept
+{
+    std::free (p);
+} // operator delete[]
+
+void operator delete (void* p, std::size_t) noexcept
+{
+    std::free (p);
+} // operator delete
+
+void operator delete[] (void* p, std::size_t) noexcept
+{
+    std::free (p);
+} // operator delete[]
+
+namespace {
+
+    struct Parameters {
+        OutputFormat format = OutputFormat::JSON;
+        std::string output = "/dev/null";
+        std::uint64_t bytes = 64 << 20;
+        unsigned int depth = 32;
+        unsigned int length = 10000;
+    }; // struct Parameters
+
+    // Writes one unit of a case and returns the number of values in it.
+    // Objects and arrays count as one value each, keys are not counted.
+    typedef std::uint64_t (*Writer) (OutputStream& stream, const Parameters& params,
+                                     std::uint64_t n);
+
+    struct Case {
+        const char* name;
+        Writer writer;
+    }; // struct Case
+
+    std::uint64_t write_deep_objects (OutputStream& stream, const Parameters& params,
+                                      std::uint64_t n);
+    std::uint64_t write_escaped_strings (OutputStream& stream, const Parameters& params,
+                                         std::uint64_t n);
+    std::uint64_t write_integers (OutputStream& stream, const Parameters& params,
+                                  std::uint64_t n);
+    std::uint64_t write_long_arrays (OutputStream& stream, const Parameters& params,
+                                     std::uint64_t n);
+    void run_case (const Parameters& params, const Case& c, bool compact);
+    void usage ();
+
+    const Case cases[] = {
+        { "deep_objects", write_deep_objects },
+        { "long_arrays", write_long_arrays },
+        { "escaped_strings", write_escaped_strings },
+        { "integers", write_integers }
+    };
+
+    std::uint64_t
+    write_deep_objects (OutputStream& stream, const Parameters& params, std::uint64_t n)
+    {
+        // Nested declaration-like objects, as written for scopes and types
+        for (unsigned int j = 0; j < params.depth; j++) {
+            stream.new_object ();
+            stream["id"_key] << n + j;
+            stream["node type"_key] << "record_type";
+            stream["location"_key].new_array (true) << 1u << j << 5u;
+            stream.end_array ();
+            stream["context"_key];
+        } // for
+        stream << Null;
+        for (unsigned int j = 0; j < params.depth; j++)
+            stream.end_object ();
+        return params.depth * 7 + 1;
+    } // write_deep_objects
+
+    std::uint64_t
+    write_long_arrays (OutputStream& stream, const Parameters& params, std::uint64_t n)
+    {
+        // Arrays of short references, as written for fields and members
+        stream.new_array ();
+        for (unsigned int j = 0; j < params.length; j++) {
+            stream.new_object (true);
+            stream["ref"_key] << n + j;
+            stream.end_object ();
+        } // for
+        stream.end_array ();
+        return params.length * 2 + 1;
+    } // write_long_arrays
+
+    std::uint64_t
+    write_escaped_strings (OutputStream& stream, const Parameters& params, std::uint64_t)
+    {
+        // Strings where about every fourth character needs escaping
+        static const char text[] =
+            "#define STR(x) \"x\"\n\tconst char* path = \"C:\\\\dir\\\\file\";\r\n"
+            "\x01\x02 printf (\"%s\\n\", \"a \\\"quoted\\\" word\");\x1f\f\b";
+        stream.new_array ();
+        for (unsigned int j = 0; j < params.length; j++)
+            stream.write_string (text, sizeof (text) - 1 - j % 16);
+        stream.end_array ();
+        return params.length + 1;
+    } // write_escaped_strings
+
+    std::uint64_t
+    write_integers (OutputStream& stream, const Parameters& params, std::uint64_t n)
+    {
+        // Mix of small ids, negative constants and full 64-bit values
+        std::uint64_t x = n;
+        stream.new_array ();
+        for (unsigned int j = 0; j < params.length; j++) {
+            x = x * 6364136223846793005ull + 1442695040888963407ull;
+            switch (j % 4) {
+            case 0:
+                stream << static_cast<unsigned int> (x >> 52);
+                break;
+            case 1:
+                stream << -static_cast<long long> (x >> 40);
+                break;
+            case 2:
+                stream << static_cast<unsigned long long> (x);
+                break;
+            default:
+                stream << static_cast<long long> (x);
+            } // switch
+        } // for
+        stream.end_array ();
+        return params.length + 1;
+    } // write_integers
+
+    void
+    run_case (const Parameters& params, const Case& c, bool compact)
+    {
+        auto stream = open_output_stream (params.output.c_str (), params.format,
+                                          Compression (), compact);
+
+        // Pretty streams hold a single root value, records any number
+        std::uint64_t values = 0;
+        std::uint64_t start_allocations = allocations;
+        auto start = std::chrono::steady_clock::now ();
+        if (!compact)
+            stream->new_array ();
+        while (stream->offset () < params.bytes)
+            values += c.writer (*stream, params, values);
+        if (!compact)
+            stream->end_array ();
+        std::uint64_t bytes = stream->offset ();
+        stream->close ();
+        auto end = std::chrono::steady_clock::now ();
+        std::uint64_t used_allocations = allocations - start_allocations;
+
+        double seconds = std::chrono::duration<double> (end - start).count ();
+        std::cout << std::left << std::setw (16) << c.name
+                  << std::setw (8) << (compact ? "compact" : "pretty")
+                  << std::right << std::setw (12) << bytes
+                  << std::fixed << std::setprecision (3)
+                  << std::setw (10) << seconds
+                  << std::setprecision (1)
+                  << std::setw (10) << bytes / seconds / (1 << 20)
+                  << std::setw (12) << values
+                  << std::setprecision (6)
+                  << std::setw (14) << double (used_allocations) / values
+                  << "\n";
+    } // run_case
+
+    void
+    usage ()
+    {
+        std::cerr << "Usage: streams [-f json|cbor] [-o file] [-m megabytes]"
+                  << " [-d depth] [-l length] [case...]\n"
+                  << "Cases:";
+        for (const Case& c : cases)
+            std::cerr << " " << c.name;
+        std::cerr << "\n";
+        std::exit (1);
+    } // usage
+
+} // namespace
+
+int
+main (int argc, char* argv[])
+{
+    Parameters params;
+    int option;
+    while ((option = getopt (argc, argv, "f:o:m:d:l:h")) != -1) {
+        switch (option) {
+        case 'f':
+            if (!std::strcmp (optarg, "json"))
+                params.format = OutputFormat::JSON;
+            else if (!std::strcmp (optarg, "cbor"))
+                params.format = OutputFormat::CBOR;
+            else
+                usage ();
+            break;
+        case 'o':
+            params.output = optarg;
+            break;
+        case 'm':
+            params.bytes = std::strtoull (optarg, nullptr, 10) << 20;
+            break;
+        case 'd':
+            params.depth = std::strtoul (optarg, nullptr, 10);
+            break;
+        case 'l':
+            params.length = std::strtoul (optarg, nullptr, 10);
+            break;
+        default:
+            usage ();
+        } // switch
+    } // while
+
+    if (params.bytes == 0 || params.depth == 0 || params.length == 0)
+        usage ();
+    for (int j = optind; j < argc; j++) {
+        bool known = false;
+        for (const Case& c : cases)
+            known = known || !std::strcmp (argv[j], c.name);
+        if (!known)
+            usage ();
+    } // for
+
+    std::cout << std::left << std::setw (16) << "case" << std::setw (8) << "mode"
+              << std::right << std::setw (12) << "bytes" << std::setw (10) << "seconds"
+              << std::setw (10) << "MB/s" << std::setw (12) << "values"
+              << std::setw (14) << "allocs/value" << "\n";
+
+    try {
+        for (const Case& c : cases) {
+            bool selected = optind == argc;
+            for (int j = optind; j < argc && !selected; j++)
+                selected = !std::strcmp (argv[j], c.name);
+            if (!selected)
+                continue;
+
+            run_case (params, c, false);
+            run_case (params, c, true);
+        } // for
+    } catch (const std::exception& e) {
+        std::cerr << "streams: " << e.what () << "\n";
+        return 1;
+    } // try
+    return 0;
+} // main
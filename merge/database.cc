@@ -0,0 +1,88 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#include <algorithm>
+#include <functional>
+#include <tuple>
+
+#include "database.h"
+
+namespace treecreeper {
+namespace merge {
+
+    std::string MergedDeclaration::key () const
+    {
+        std::string result;
+        result.reserve (node_type.size () + qualified_name.size ()
+                        + file.size () + shape.size () + 48);
+        result += node_type;
+        result += '\0';
+        result += qualified_name;
+        result += '\0';
+        result += file;
+        result += ':';
+        result += std::to_string (line);
+        result += ':';
+        result += std::to_string (column);
+        result += '\0';
+        result += shape;
+        return result;
+    } // MergedDeclaration::key
+
+    void Database::add_unit (unsigned int unit,
+                             std::vector<MergedDeclaration>& declarations)
+    {
+        // Group by shard first, so each lock is taken once per unit
+        std::vector<std::pair<std::string, MergedDeclaration*>> by_shard[shard_count];
+        for (auto& decl : declarations) {
+            std::string key = decl.key ();
+            std::size_t shard = std::hash<std::string> () (key) % shard_count;
+            by_shard[shard].emplace_back (std::move (key), &decl);
+        } // for
+
+        for (std::size_t j = 0; j < shard_count; j++) {
+            if (by_shard[j].empty ())
+                continue;
+
+            std::lock_guard<std::mutex> lock (shards[j].mutex);
+            for (auto& elem : by_shard[j]) {
+                auto inserted = shards[j].declarations.emplace (std::move (elem.first),
+                                                                MergedDeclaration ());
+                MergedDeclaration& merged = inserted.first->second;
+                if (inserted.second) {
+                    merged = std::move (*elem.second);
+                    merged.source_unit = unit;
+                } else if (merged.units.back () == unit) {
+                    // Another node of the same unit, e.g. a redeclaration
+                    continue;
+                } else if (unit < merged.source_unit) {
+                    // Prefer the first unit regardless of the thread order
+                    merged.source_unit = unit;
+                    merged.source_id = elem.second->source_id;
+                } // if
+                merged.units.push_back (unit);
+            } // for
+        } // for
+    } // Database::add_unit
+
+    std::vector<const MergedDeclaration*> Database::sorted ()
+    {
+        std::vector<const MergedDeclaration*> result;
+        for (auto& shard : shards) {
+            for (auto& elem : shard.declarations) {
+                std::sort (elem.second.units.begin (), elem.second.units.end ());
+                result.push_back (&elem.second);
+            } // for
+        } // for
+
+        std::sort (result.begin (), result.end (),
+                   [] (const MergedDeclaration* a, const MergedDeclaration* b) {
+                       return std::tie (a->qualified_name, a->file, a->line,
+                                        a->column, a->node_type, a->shape)
+                           < std::tie (b->qualified_name, b->file, b->line,
+                                       b->column, b->node_type, b->shape);
+                   });
+        return result;
+    } // Database::sorted
+
+} // namespace merge
+} // namespace treecreeper
@@ -0,0 +1,72 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#ifndef MERGE_DATABASE_H
+#define MERGE_DATABASE_H
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace treecreeper {
+
+    namespace reader {
+        class Document;
+    } // namespace reader
+
+namespace merge {
+
+    // A file or namespace scope declaration, which is the same in every
+    // unit where the node type, qualified name, location and type shape
+    // match
+    struct MergedDeclaration {
+        std::string node_type;
+        std::string qualified_name;
+        std::string file;
+        unsigned long line = 0;
+        unsigned long column = 0;
+        std::string shape;
+
+        // Units which contain the declaration, and the node in the first of
+        // them, where the full declaration can be read
+        std::vector<unsigned int> units;
+        unsigned int source_unit = 0;
+        unsigned long source_id = 0;
+
+        std::string key () const;
+    }; // struct MergedDeclaration
+
+    // Declarations of all units. Units are added from several threads at
+    // once, so the table is split into shards with their own locks.
+    class Database {
+
+    private:
+        static const std::size_t shard_count = 64;
+
+        struct Shard {
+            std::mutex mutex;
+            std::unordered_map<std::string, MergedDeclaration> declarations;
+        }; // struct Shard
+
+        Shard shards[shard_count];
+
+    public:
+        // Add the declarations of one unit. The declarations are moved
+        // from.
+        void add_unit (unsigned int unit, std::vector<MergedDeclaration>& declarations);
+
+        // All declarations sorted by qualified name and location, each with
+        // a sorted list of units. Call only after all units are added.
+        std::vector<const MergedDeclaration*> sorted ();
+    }; // class Database
+
+    // Append the file and namespace scope declarations of a JSON dump.
+    // Throws std::runtime_error if the file is not a treecreeper dump.
+    void collect_declarations (const reader::Document& document,
+                               std::vector<MergedDeclaration>& result);
+
+} // namespace merge
+} // namespace treecreeper
+
+#endif // MERGE_DATABASE_H
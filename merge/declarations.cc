@@ -0,0 +1,163 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "database.h"
+#include "document.h"
+#include "views.h"
+
+namespace treecreeper {
+namespace merge {
+
+    using reader::Declaration;
+    using reader::Document;
+    using reader::NodeView;
+    using reader::StringRef;
+    using reader::Type;
+    using reader::Value;
+
+    // Qualified name prefixes of scopes by node id
+    typedef std::unordered_map<unsigned long, std::string> ScopeCache;
+
+    // Types are described down to this depth in the shape
+    static const int shape_depth = 3;
+
+    static void append (std::string& str, const StringRef& value);
+    static void append_shape (std::string& shape, const Value& node, int depth);
+    static bool is_scope (const NodeView& node);
+    static std::string scope_prefix (const NodeView& scope, ScopeCache& cache);
+
+    void collect_declarations (const Document& document,
+                               std::vector<MergedDeclaration>& result)
+    {
+        if (!document.root ().is_object ())
+            throw std::runtime_error ("not a treecreeper JSON file");
+
+        ScopeCache scopes;
+        for (unsigned long id : document.ids ()) {
+            Value node = document.find (id);
+            if (!node || !Declaration::is (node))
+                continue;
+
+            Declaration decl (node);
+            if (is_scope (decl))
+                continue;
+
+            // Declarations without a context are at file scope too
+            NodeView context (decl.context ());
+            if (context && !is_scope (context))
+                continue;
+
+            MergedDeclaration merged;
+            append (merged.node_type, decl.node_type ());
+            if (context)
+                merged.qualified_name = scope_prefix (context, scopes);
+            append (merged.qualified_name, decl.name ());
+
+            auto location = decl.location ();
+            append (merged.file, location.file);
+            merged.line = location.line;
+            merged.column = location.column;
+
+            append_shape (merged.shape, decl.type (), shape_depth);
+            merged.source_id = id;
+            result.push_back (std::move (merged));
+        } // for
+    } // collect_declarations
+
+    static void
+    append (std::string& str, const StringRef& value)
+    {
+        // Only the rare escaped strings are decoded
+        if (value.is_escaped ())
+            str += value.str ();
+        else
+            str.append (value.data (), value.size ());
+    } // append
+
+    static void
+    append_shape (std::string& shape, const Value& node, int depth)
+    {
+        Type type (node);
+        if (!type || !Type::is (node)) {
+            shape += '-';
+            return;
+        } // if
+
+        append (shape, type.node_type ());
+        StringRef name = type.name ();
+        if (!name.empty ()) {
+            shape += ' ';
+            append (shape, name);
+        } // if
+        for (auto& qualifier : node["qualifiers"].items ()) {
+            shape += ' ';
+            append (shape, qualifier.as_string ());
+        } // for
+        if (type.size () >= 0) {
+            shape += '/';
+            shape += std::to_string (type.size ());
+        } // if
+
+        if (depth == 0)
+            return;
+
+        for (auto key : { "referred type", "element type", "result type" }) {
+            Value next = type.follow (key);
+            if (next) {
+                shape += '(';
+                append_shape (shape, next, depth - 1);
+                shape += ')';
+            } // if
+        } // for
+
+        Value arguments = node["argument types"];
+        if (arguments.is_array ()) {
+            const Document* document = node.get_document ();
+            shape += '(';
+            for (auto& argument : arguments.items ()) {
+                append_shape (shape, document->resolve (argument), depth - 1);
+                shape += ',';
+            } // for
+            shape += ')';
+        } // if
+    } // append_shape
+
+    static bool
+    is_scope (const NodeView& node)
+    {
+        StringRef node_type = node.node_type ();
+        return node_type == "namespace_decl" || node_type == "translation_unit_decl";
+    } // is_scope
+
+    static std::string
+    scope_prefix (const NodeView& scope, ScopeCache& cache)
+    {
+        auto cached = cache.find (scope.id ());
+        if (cached != cache.end ())
+            return cached->second;
+
+        // The global namespace is named ::, and anonymous namespaces have
+        // no name
+        std::string prefix;
+        StringRef name = scope.name ();
+        if (scope.node_type () == "namespace_decl" && name != "::") {
+            NodeView context (scope.follow ("context"));
+            if (context && is_scope (context))
+                prefix = scope_prefix (context, cache);
+            if (name.empty ())
+                prefix += "(anonymous namespace)";
+            else
+                append (prefix, name);
+            prefix += "::";
+        } // if
+
+        cache.emplace (scope.id (), prefix);
+        return prefix;
+    } // scope_prefix
+
+} // namespace merge
+} // namespace treecreeper
@@ -0,0 +1,190 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+// treecreeper-merge: merge the JSON dumps of many translation units into
+// one database of declarations, with the units that contain each of them.
+
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "database.h"
+#include "document.h"
+#include "json_stream.h"
+
+using namespace treecreeper;
+
+static void add_input (std::vector<std::string>& inputs, const char* arg);
+static void merge_units (const std::vector<std::string>& inputs, merge::Database& database,
+                         unsigned int jobs);
+static void print_database (const char* output, const std::vector<std::string>& inputs,
+                            merge::Database& database);
+static void usage ();
+
+int
+main (int argc, char** argv)
+{
+    const char* output = nullptr;
+    unsigned int jobs = std::thread::hardware_concurrency ();
+
+    int c;
+    while ((c = getopt (argc, argv, "hj:o:")) != -1) {
+        switch (c) {
+        case 'j':
+            jobs = std::atoi (optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'h':
+        default:
+            usage ();
+        } // switch
+    } // while
+
+    if (!output || optind == argc)
+        usage ();
+    if (jobs == 0)
+        jobs = 1;
+
+    std::vector<std::string> inputs;
+    try {
+        for (int j = optind; j < argc; j++)
+            add_input (inputs, argv[j]);
+
+        merge::Database database;
+        merge_units (inputs, database, jobs);
+        print_database (output, inputs, database);
+    } catch (std::exception& e) {
+        std::cerr << "treecreeper-merge: " << e.what () << std::endl;
+        return 1;
+    } // catch
+    return 0;
+} // main
+
+static void
+add_input (std::vector<std::string>& inputs, const char* arg)
+{
+    // @file lists inputs one per line, for builds with thousands of units
+    if (arg[0] != '@') {
+        inputs.push_back (arg);
+        return;
+    } // if
+
+    std::ifstream list (arg + 1);
+    if (!list)
+        throw std::runtime_error (std::string ("cannot read ") + (arg + 1));
+    std::string line;
+    while (std::getline (list, line)) {
+        if (!line.empty ())
+            inputs.push_back (line);
+    } // while
+} // add_input
+
+static void
+merge_units (const std::vector<std::string>& inputs, merge::Database& database,
+             unsigned int jobs)
+{
+    // Each thread maps one input at a time and unmaps it before taking the
+    // next one, so memory use does not grow with the number of inputs
+    std::atomic<std::size_t> next (0);
+    std::mutex error_mutex;
+    std::string error;
+
+    auto fail = [&] (const std::string& message) {
+        std::lock_guard<std::mutex> lock (error_mutex);
+        if (error.empty ())
+            error = message;
+        next = inputs.size ();
+    };
+
+    auto worker = [&] () {
+        std::vector<merge::MergedDeclaration> declarations;
+        for (std::size_t unit; (unit = next++) < inputs.size ();) {
+            try {
+                reader::Document document (inputs[unit].c_str ());
+                declarations.clear ();
+                merge::collect_declarations (document, declarations);
+                database.add_unit (unit, declarations);
+            } catch (std::system_error& e) {
+                // The message names the file already
+                fail (e.what ());
+            } catch (std::exception& e) {
+                fail (inputs[unit] + ": " + e.what ());
+            } // catch
+        } // for
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int j = 1; j < jobs && j < inputs.size (); j++)
+        threads.emplace_back (worker);
+    worker ();
+    for (auto& thread : threads)
+        thread.join ();
+
+    if (!error.empty ())
+        throw std::runtime_error (error);
+} // merge_units
+
+static void
+print_database (const char* output, const std::vector<std::string>& inputs,
+                merge::Database& database)
+{
+    JSONStream stream (output);
+    stream.new_object ();
+    stream["kind"_key] << "merged_root";
+
+    stream["units"_key].new_array ();
+    for (auto& input : inputs)
+        stream << input;
+    stream.end_array ();
+
+    stream["declarations"_key].new_array ();
+    for (auto decl : database.sorted ()) {
+        stream.new_object ();
+        stream["kind"_key] << "merged_declaration";
+        stream["node type"_key] << decl->node_type;
+        stream["qualified name"_key] << decl->qualified_name;
+
+        stream["location"_key];
+        if (decl->file.empty ())
+            stream << Null;
+        else {
+            stream.new_array (true);
+            stream << decl->file << decl->line << decl->column;
+            stream.end_array ();
+        } // if
+        stream["type shape"_key] << decl->shape;
+
+        stream["units"_key].new_array (true);
+        for (auto unit : decl->units)
+            stream << unit;
+        stream.end_array ();
+
+        stream["source"_key].new_object (true);
+        stream["unit"_key] << decl->source_unit;
+        stream["id"_key] << decl->source_id;
+        stream.end_object ();
+        stream.end_object ();
+    } // for
+    stream.end_array ();
+
+    stream.end_object ();
+    stream.close ();
+} // print_database
+
+static void
+usage ()
+{
+    std::cerr << "Usage: treecreeper-merge [-j jobs] -o output input... [@list...]"
+              << std::endl;
+    std::exit (1);
+} // usage
@@ -0,0 +1,250 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "document.h"
+#include "json_scan.h"
+
+namespace treecreeper {
+namespace reader {
+
+    static const char* expect (const char* p, const char* end, const char* token);
+    static bool parse_node_head (const char* p, const char* end, unsigned long& id);
+
+    Document::Document (const char* filename)
+    {
+        fd = ::open (filename, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error (errno, std::generic_category (), filename);
+
+        struct stat st;
+        if (::fstat (fd, &st) < 0) {
+            int error = errno;
+            ::close (fd);
+            throw std::system_error (error, std::generic_category (), filename);
+        } // if
+
+        length = st.st_size;
+        if (length > 0) {
+            void* map = ::mmap (nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) {
+                int error = errno;
+                ::close (fd);
+                throw std::system_error (error, std::generic_category (), filename);
+            } // if
+            bytes = static_cast<const char*> (map);
+        } // if
+    } // Document::Document
+
+    Document::~Document ()
+    {
+        if (bytes)
+            ::munmap (const_cast<char*> (bytes), length);
+        if (fd >= 0)
+            ::close (fd);
+    } // Document::~Document
+
+    Value Document::root () const
+    {
+        const char* p = skip_whitespace (begin (), end ());
+        if (p >= end ())
+            return Value ();
+        return Value (this, p);
+    } // Document::root
+
+    bool Document::is_records () const
+    {
+        return root ()["kind"].as_string () == "header";
+    } // Document::is_records
+
+    Value Document::find (unsigned long id) const
+    {
+        if (!nodes_indexed)
+            index_nodes ();
+        if (id < nodes.size ()) {
+            if (nodes[id])
+                return Value (this, nodes[id]);
+        } else {
+            auto sparse = sparse_nodes.find (id);
+            if (sparse != sparse_nodes.end ())
+                return Value (this, sparse->second);
+        } // if
+        return Value ();
+    } // Document::find
+
+    Value Document::resolve (const Value& value) const
+    {
+        if (value.is_number ())
+            return find (value.as_integer ());
+        else if (value.is_object () && value["kind"].as_string () == "reference")
+            return find (value["referred id"].as_integer ());
+        return value;
+    } // Document::resolve
+
+    StringRef Document::name (const Value& value) const
+    {
+        if (value.is_string ())
+            return value.as_string ();
+        else if (!value.is_number ())
+            return StringRef ();
+
+        if (!tables_loaded)
+            load_tables ();
+        std::size_t index = value.as_integer ();
+        if (index < string_entries.size ())
+            return string_entries[index].as_string ();
+        return StringRef ();
+    } // Document::name
+
+    Value Document::file (std::size_t index) const
+    {
+        if (!tables_loaded)
+            load_tables ();
+        if (index < file_entries.size ())
+            return file_entries[index];
+        return Value ();
+    } // Document::file
+
+    std::size_t Document::node_count () const
+    {
+        if (!nodes_indexed)
+            index_nodes ();
+        return sparse_nodes.size ()
+            + std::count_if (nodes.begin (), nodes.end (),
+                             [] (const char* node) { return node != nullptr; });
+    } // Document::node_count
+
+    std::vector<unsigned long> Document::ids () const
+    {
+        if (!nodes_indexed)
+            index_nodes ();
+
+        std::vector<unsigned long> result;
+        for (std::size_t id = 0; id < nodes.size (); id++) {
+            if (nodes[id])
+                result.push_back (id);
+        } // for
+        for (auto& elem : sparse_nodes)
+            result.push_back (elem.first);
+        std::sort (result.begin () + (result.size () - sparse_nodes.size ()), result.end ());
+        return result;
+    } // Document::ids
+
+    void Document::index_nodes () const
+    {
+        // One pass over the whole file. Objects of tree nodes start with
+        // their kind and id, which is all we need to look at. Nodes written
+        // more than once in records mode are found at their last position.
+        // Each node takes more than 16 bytes, so sequential ids are below
+        // this bound
+        const std::size_t dense_limit = length / 16 + 1;
+
+        const char* p = begin ();
+        const char* last = end ();
+        while (p < last) {
+            if (*p == '"') {
+                p = skip_string (p, last);
+                continue;
+            } else if (*p == '{') {
+                unsigned long id;
+                if (parse_node_head (p + 1, last, id)) {
+                    if (id >= dense_limit)
+                        sparse_nodes[id] = p;
+                    else {
+                        if (id >= nodes.size ())
+                            nodes.resize (id + 1);
+                        nodes[id] = p;
+                    } // if
+                } // if
+            } // if
+            p++;
+        } // while
+        nodes_indexed = true;
+    } // Document::index_nodes
+
+    void Document::load_tables () const
+    {
+        // Tables are in the root object, or in the trailer record
+        Value source = root ();
+        if (is_records ()) {
+            for (auto& record : records ()) {
+                if (record["kind"].as_string () == "trailer")
+                    source = record;
+            } // for
+        } // if
+
+        files = source["files"];
+        for (auto& entry : files.items ())
+            file_entries.push_back (entry);
+        strings = source["strings"];
+        for (auto& entry : strings.items ())
+            string_entries.push_back (entry);
+        tables_loaded = true;
+    } // Document::load_tables
+
+    Document::RecordIterator::RecordIterator (const Document* document,
+                                              const char* position)
+        : document (document)
+    {
+        const char* p = skip_whitespace (position, document->end ());
+        if (p < document->end ())
+            current = Value (document, p);
+    } // Document::RecordIterator::RecordIterator
+
+    Document::RecordIterator& Document::RecordIterator::operator++ ()
+    {
+        const char* p = skip_whitespace (current.end (), document->end ());
+        if (p < document->end ())
+            current = Value (document, p);
+        else
+            current = Value ();
+        return *this;
+    } // Document::RecordIterator::operator++
+
+    static const char*
+    expect (const char* p, const char* end, const char* token)
+    {
+        std::size_t length = std::strlen (token);
+        p = skip_whitespace (p, end);
+        if (std::size_t (end - p) < length || std::memcmp (p, token, length))
+            return nullptr;
+        return p + length;
+    } // expect
+
+    static bool
+    parse_node_head (const char* p, const char* end, unsigned long& id)
+    {
+        // Matches "kind": "gcc_tree", "id": <number> or the same with
+        // unsupported_gcc_tree
+        if (!(p = expect (p, end, "\"kind\"")) || !(p = expect (p, end, ":")))
+            return false;
+
+        const char* kind = p;
+        if (!(p = expect (kind, end, "\"gcc_tree\""))
+            && !(p = expect (kind, end, "\"unsupported_gcc_tree\"")))
+            return false;
+
+        if (!(p = expect (p, end, ",")) || !(p = expect (p, end, "\"id\""))
+            || !(p = expect (p, end, ":")))
+            return false;
+
+        p = skip_whitespace (p, end);
+        if (p >= end || *p < '0' || *p > '9')
+            return false;
+        id = 0;
+        while (p < end && *p >= '0' && *p <= '9')
+            id = id * 10 + (*p++ - '0');
+        return true;
+    } // parse_node_head
+
+} // namespace reader
+} // namespace treecreeper
@@ -0,0 +1,128 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#ifndef READER_DOCUMENT_H
+#define READER_DOCUMENT_H
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "value.h"
+
+namespace treecreeper {
+namespace reader {
+
+    // A treecreeper output file in JSON format, mapped to memory. The file
+    // may hold a single root object or newline-delimited records (records
+    // mode), in either the tree or the flat layout.
+    //
+    // Nothing is parsed up front. The id index and the file and string
+    // tables are built on first use.
+    class Document {
+
+    private:
+        int fd = -1;
+        const char* bytes = nullptr;
+        std::size_t length = 0;
+
+        // Objects of tree nodes by id. Sequential ids index a vector, and
+        // stable ids (ids=stable), which are hashes, go to a map.
+        mutable std::vector<const char*> nodes;
+        mutable std::unordered_map<unsigned long, const char*> sparse_nodes;
+        mutable bool nodes_indexed = false;
+
+        // Objects holding the file and string tables
+        mutable Value files;
+        mutable Value strings;
+        mutable std::vector<Value> file_entries;
+        mutable std::vector<Value> string_entries;
+        mutable bool tables_loaded = false;
+
+        void index_nodes () const;
+        void load_tables () const;
+
+    public:
+        // Throws std::system_error if the file cannot be mapped
+        explicit Document (const char* filename);
+        Document (const Document&) = delete;
+        ~Document ();
+
+        const char* begin () const
+        { return bytes; }
+        const char* end () const
+        { return bytes + length; }
+
+        // The root object, or the header record in records mode
+        Value root () const;
+
+        // True if the file consists of records
+        bool is_records () const;
+
+        class RecordIterator;
+        class RecordRange;
+
+        // All top level values, i.e. the root object or the records
+        RecordRange records () const;
+
+        // Node by its id, or a missing value
+        Value find (unsigned long id) const;
+
+        // Follow a reference object or, in the flat layout, a node id to the
+        // node itself. Other values are returned as they are.
+        Value resolve (const Value& value) const;
+
+        // Name which may be a string or an index of the string table
+        StringRef name (const Value& value) const;
+
+        // Entry of the file table, with name and system header members
+        Value file (std::size_t index) const;
+
+        // Number of nodes
+        std::size_t node_count () const;
+
+        // Ids of all nodes in ascending order
+        std::vector<unsigned long> ids () const;
+    }; // class Document
+
+    class Document::RecordIterator {
+    private:
+        const Document* document = nullptr;
+        Value current;
+
+    public:
+        RecordIterator () = default;
+        RecordIterator (const Document* document, const char* position);
+
+        const Value& operator* () const
+        { return current; }
+        const Value* operator-> () const
+        { return &current; }
+
+        RecordIterator& operator++ ();
+
+        bool operator!= (const RecordIterator& other) const
+        { return current.begin () != other.current.begin (); }
+    }; // class Document::RecordIterator
+
+    class Document::RecordRange {
+    private:
+        const Document* document;
+
+    public:
+        RecordRange (const Document* document)
+            : document (document)
+            { }
+
+        RecordIterator begin () const
+        { return RecordIterator (document, document->begin ()); }
+        RecordIterator end () const
+        { return RecordIterator (); }
+    }; // class Document::RecordRange
+
+    inline Document::RecordRange Document::records () const
+    { return RecordRange (this); }
+
+} // namespace reader
+} // namespace treecreeper
+
+#endif // READER_DOCUMENT_H
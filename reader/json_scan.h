@@ -0,0 +1,80 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#ifndef READER_JSON_SCAN_H
+#define READER_JSON_SCAN_H
+
+#include <cstring>
+
+namespace treecreeper {
+namespace reader {
+
+    // Low level helpers for moving around in JSON text without parsing it.
+    // All of them stop at end, and return end if the text is truncated.
+
+    inline const char* skip_whitespace (const char* p, const char* end)
+    {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r'))
+            p++;
+        return p;
+    } // skip_whitespace
+
+    // p points to the opening quote. Returns the position after the
+    // closing quote.
+    inline const char* skip_string (const char* p, const char* end)
+    {
+        for (p++; p < end; p++) {
+            p = static_cast<const char*> (std::memchr (p, '"', end - p));
+            if (!p)
+                return end;
+
+            // The quote is escaped if it follows an odd number of backslashes
+            const char* q = p;
+            while (q[-1] == '\\')
+                q--;
+            if ((p - q) % 2 == 0)
+                return p + 1;
+        } // for
+        return end;
+    } // skip_string
+
+    // Returns the position after the value which starts at p
+    inline const char* skip_value (const char* p, const char* end)
+    {
+        if (p >= end)
+            return end;
+
+        switch (*p) {
+        case '"':
+            return skip_string (p, end);
+        case '{': case '[': {
+            int depth = 0;
+            while (p < end) {
+                switch (*p) {
+                case '"':
+                    p = skip_string (p, end);
+                    continue;
+                case '{': case '[':
+                    depth++;
+                    break;
+                case '}': case ']':
+                    if (--depth == 0)
+                        return p + 1;
+                    break;
+                } // switch
+                p++;
+            } // while
+            return end;
+        } // case
+        default:
+            // Numbers, true, false and null
+            while (p < end && *p != ',' && *p != '}' && *p != ']'
+                   && *p != ' ' && *p != '\n' && *p != '\t' && *p != '\r')
+                p++;
+            return p;
+        } // switch
+    } // skip_value
+
+} // namespace reader
+} // namespace treecreeper
+
+#endif // READER_JSON_SCAN_H
@@ -0,0 +1,205 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#include <cstdlib>
+#include <string>
+
+#include "document.h"
+#include "json_scan.h"
+#include "value.h"
+
+namespace treecreeper {
+namespace reader {
+
+    static void append_utf8 (std::string& result, unsigned long code);
+
+    static void
+    append_utf8 (std::string& result, unsigned long code)
+    {
+        if (code < 0x80)
+            result += char (code);
+        else if (code < 0x800) {
+            result += char (0xc0 | (code >> 6));
+            result += char (0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            result += char (0xe0 | (code >> 12));
+            result += char (0x80 | ((code >> 6) & 0x3f));
+            result += char (0x80 | (code & 0x3f));
+        } else {
+            result += char (0xf0 | (code >> 18));
+            result += char (0x80 | ((code >> 12) & 0x3f));
+            result += char (0x80 | ((code >> 6) & 0x3f));
+            result += char (0x80 | (code & 0x3f));
+        } // if
+    } // append_utf8
+
+    std::string StringRef::str () const
+    {
+        if (!escaped)
+            return std::string (bytes, length);
+
+        std::string result;
+        result.reserve (length);
+        for (std::size_t j = 0; j < length; j++) {
+            if (bytes[j] != '\\' || j + 1 == length) {
+                result += bytes[j];
+                continue;
+            } // if
+
+            char c = bytes[++j];
+            switch (c) {
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'n': result += '\n'; break;
+            case 'r': result += '\r'; break;
+            case 't': result += '\t'; break;
+            case 'u':
+                if (j + 4 < length) {
+                    std::string hex (bytes + j + 1, 4);
+                    append_utf8 (result, std::strtoul (hex.c_str (), nullptr, 16));
+                    j += 4;
+                } // if
+                break;
+            default:
+                // Quotes, backslashes and slashes stand for themselves
+                result += c;
+            } // switch
+        } // for
+        return result;
+    } // StringRef::str
+
+    bool StringRef::operator== (const char* other) const
+    {
+        if (escaped)
+            return str () == other;
+        return std::strncmp (bytes, other, length) == 0 && other[length] == '\0';
+    } // StringRef::operator==
+
+    const char* Value::end () const
+    {
+        if (!position)
+            return nullptr;
+        return skip_value (position, document->end ());
+    } // Value::end
+
+    ValueType Value::type () const
+    {
+        if (!position)
+            return ValueType::Missing;
+
+        switch (*position) {
+        case 'n':
+            return ValueType::Null;
+        case 't': case 'f':
+            return ValueType::Bool;
+        case '"':
+            return ValueType::String;
+        case '[':
+            return ValueType::Array;
+        case '{':
+            return ValueType::Object;
+        default:
+            return ValueType::Number;
+        } // switch
+    } // Value::type
+
+    long long Value::as_integer (long long fallback) const
+    {
+        if (type () != ValueType::Number)
+            return fallback;
+        return std::strtoll (position, nullptr, 10);
+    } // Value::as_integer
+
+    bool Value::as_bool (bool fallback) const
+    {
+        if (type () != ValueType::Bool)
+            return fallback;
+        return *position == 't';
+    } // Value::as_bool
+
+    StringRef Value::as_string () const
+    {
+        if (type () != ValueType::String)
+            return StringRef ();
+
+        const char* last = skip_string (position, document->end ()) - 1;
+        const char* first = position + 1;
+        std::size_t length = last - first;
+        bool escaped = std::memchr (first, '\\', length) != nullptr;
+        return StringRef (first, length, escaped);
+    } // Value::as_string
+
+    Value Value::operator[] (const char* key) const
+    {
+        if (type () != ValueType::Object)
+            return Value ();
+
+        for (auto it = items ().begin (); it != Iterator (); ++it) {
+            if (it.key () == key)
+                return *it;
+        } // for
+        return Value ();
+    } // Value::operator[]
+
+    Value Value::at (std::size_t index) const
+    {
+        if (type () != ValueType::Array)
+            return Value ();
+
+        for (auto it = items ().begin (); it != Iterator (); ++it) {
+            if (index-- == 0)
+                return *it;
+        } // for
+        return Value ();
+    } // Value::at
+
+    std::size_t Value::size () const
+    {
+        std::size_t count = 0;
+        for (auto it = items ().begin (); it != Iterator (); ++it)
+            count++;
+        return count;
+    } // Value::size
+
+    Value::Iterator::Iterator (const Value& container)
+    {
+        auto type = container.type ();
+        if (type != ValueType::Array && type != ValueType::Object)
+            return;
+
+        in_object = type == ValueType::Object;
+        current = Value (container.document, container.position);
+        load (container.position + 1);
+    } // Value::Iterator::Iterator
+
+    void Value::Iterator::load (const char* p)
+    {
+        // p is after an opening bracket or a comma
+        const char* end = current.document->end ();
+        p = skip_whitespace (p, end);
+        if (p >= end || *p == ']' || *p == '}') {
+            current = Value ();
+            return;
+        } // if
+
+        if (in_object) {
+            Value key (current.document, p);
+            current_key = key.as_string ();
+            p = skip_whitespace (skip_string (p, end), end);
+            p = skip_whitespace (p + 1, end); // Colon
+        } // if
+        current = Value (current.document, p);
+    } // Value::Iterator::load
+
+    Value::Iterator& Value::Iterator::operator++ ()
+    {
+        const char* end = current.document->end ();
+        const char* p = skip_whitespace (current.end (), end);
+        if (p < end && *p == ',')
+            load (p + 1);
+        else
+            current = Value ();
+        return *this;
+    } // Value::Iterator::operator++
+
+} // namespace reader
+} // namespace treecreeper
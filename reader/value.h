@@ -0,0 +1,168 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#ifndef READER_VALUE_H
+#define READER_VALUE_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+namespace treecreeper {
+namespace reader {
+
+    class Document;
+
+    // String in the mapped file. Strings with escapes are referenced in
+    // their escaped form, use str to decode them.
+    class StringRef {
+    private:
+        const char* bytes = nullptr;
+        std::size_t length = 0;
+        bool escaped = false;
+
+    public:
+        StringRef () = default;
+
+        StringRef (const char* bytes, std::size_t length, bool escaped = false)
+            : bytes (bytes), length (length), escaped (escaped)
+            { }
+
+        const char* data () const
+        { return bytes; }
+
+        std::size_t size () const
+        { return length; }
+
+        bool empty () const
+        { return length == 0; }
+
+        bool is_escaped () const
+        { return escaped; }
+
+        // Decoded copy of the string
+        std::string str () const;
+
+        bool operator== (const char* other) const;
+
+        bool operator!= (const char* other) const
+        { return !(*this == other); }
+    }; // class StringRef
+
+    enum class ValueType {
+        Missing,
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object
+    };
+
+    // A JSON value in the mapped file. Values are a pair of pointers and
+    // cheap to copy. Nothing is parsed until it is asked for, and a missing
+    // value (e.g. an absent object member) is represented by a Value of type
+    // Missing.
+    class Value {
+    private:
+        const Document* document = nullptr;
+        const char* position = nullptr;
+
+    public:
+        Value () = default;
+
+        Value (const Document* document, const char* position)
+            : document (document), position (position)
+            { }
+
+        const Document* get_document () const
+        { return document; }
+
+        // First byte of the value and the position after it
+        const char* begin () const
+        { return position; }
+        const char* end () const;
+
+        ValueType type () const;
+
+        explicit operator bool () const
+        { return position != nullptr; }
+
+        bool is_null () const
+        { return type () == ValueType::Null; }
+        bool is_number () const
+        { return type () == ValueType::Number; }
+        bool is_string () const
+        { return type () == ValueType::String; }
+        bool is_array () const
+        { return type () == ValueType::Array; }
+        bool is_object () const
+        { return type () == ValueType::Object; }
+
+        long long as_integer (long long fallback = 0) const;
+        bool as_bool (bool fallback = false) const;
+        StringRef as_string () const;
+
+        // Object member by key and array element by index
+        Value operator[] (const char* key) const;
+        Value at (std::size_t index) const;
+
+        // Number of elements or members
+        std::size_t size () const;
+
+        class Iterator;
+        class Range;
+
+        // Iterate over array elements. Keys of object members are available
+        // from Iterator::key.
+        Range items () const;
+    }; // class Value
+
+    class Value::Iterator {
+    private:
+        Value current;
+        StringRef current_key;
+        bool in_object = false;
+
+        void load (const char* p);
+
+    public:
+        Iterator () = default;
+        Iterator (const Value& container);
+
+        const Value& operator* () const
+        { return current; }
+        const Value* operator-> () const
+        { return &current; }
+
+        // Key of the current member, when iterating over an object
+        const StringRef& key () const
+        { return current_key; }
+
+        Iterator& operator++ ();
+
+        bool operator!= (const Iterator& other) const
+        { return current.begin () != other.current.begin (); }
+    }; // class Value::Iterator
+
+    class Value::Range {
+    private:
+        Value container;
+
+    public:
+        Range (const Value& container)
+            : container (container)
+            { }
+
+        Iterator begin () const
+        { return Iterator (container); }
+        Iterator end () const
+        { return Iterator (); }
+    }; // class Value::Range
+
+    inline Value::Range Value::items () const
+    { return Range (*this); }
+
+} // namespace reader
+} // namespace treecreeper
+
+#endif // READER_VALUE_H
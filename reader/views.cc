@@ -0,0 +1,78 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#include <cstring>
+
+#include "views.h"
+
+namespace treecreeper {
+namespace reader {
+
+    static bool ends_with (const StringRef& str, const char* suffix);
+
+    Location get_location (const Value& value)
+    {
+        Location location;
+        const Document* document = value.get_document ();
+
+        if (value.is_array ()) {
+            Value file = document->file (value.at (0).as_integer ());
+            location.file = file["name"].as_string ();
+            location.system_header = file["system header"].as_bool ();
+            location.line = value.at (1).as_integer ();
+            location.column = value.at (2).as_integer ();
+        } else if (value.is_object ()) {
+            location.file = value["file"].as_string ();
+            location.system_header = value["system header"].as_bool ();
+            location.line = value["line"].as_integer ();
+            location.column = value["column"].as_integer ();
+        } else if (value.is_string ()) {
+            location.builtin = value.as_string () == "built-in";
+        } // if
+        return location;
+    } // get_location
+
+    StringRef NodeView::name () const
+    {
+        // Identifiers are printed in full as a string or a string table
+        // index. Conversion operators are objects and have no plain name.
+        return value.get_document ()->name (value["name"]);
+    } // NodeView::name
+
+    Value NodeView::follow (const char* key) const
+    {
+        Value target = value[key];
+        if (!target || target.is_null ())
+            return Value ();
+        return value.get_document ()->resolve (target);
+    } // NodeView::follow
+
+    bool Declaration::is (const Value& value)
+    {
+        return ends_with (value["node type"].as_string (), "_decl");
+    } // Declaration::is
+
+    bool Type::is (const Value& value)
+    {
+        return ends_with (value["node type"].as_string (), "_type");
+    } // Type::is
+
+    bool Macro::is (const Value& value)
+    {
+        return value["kind"].as_string () == "gcc_macro";
+    } // Macro::is
+
+    StringRef Macro::name () const
+    {
+        return value.get_document ()->name (value["name"]);
+    } // Macro::name
+
+    static bool
+    ends_with (const StringRef& str, const char* suffix)
+    {
+        std::size_t length = std::strlen (suffix);
+        return str.size () >= length
+            && !std::memcmp (str.data () + str.size () - length, suffix, length);
+    } // ends_with
+
+} // namespace reader
+} // namespace treecreeper
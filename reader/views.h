@@ -0,0 +1,135 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#ifndef READER_VIEWS_H
+#define READER_VIEWS_H
+
+#include "document.h"
+#include "value.h"
+
+namespace treecreeper {
+namespace reader {
+
+    // Source location in either of the output formats: a [file, line,
+    // column] tuple into the file table, a source_location object or the
+    // string "built-in". Unknown locations convert to false.
+    struct Location {
+        StringRef file;
+        unsigned long line = 0;
+        unsigned long column = 0;
+        bool system_header = false;
+        bool builtin = false;
+
+        explicit operator bool () const
+        { return builtin || !file.empty (); }
+    }; // struct Location
+
+    Location get_location (const Value& value);
+
+    // Common members of the objects with kind gcc_tree and
+    // unsupported_gcc_tree
+    class NodeView {
+    protected:
+        Value value;
+
+    public:
+        NodeView (const Value& value)
+            : value (value)
+            { }
+
+        const Value& get_value () const
+        { return value; }
+
+        explicit operator bool () const
+        { return bool (value); }
+
+        unsigned long id () const
+        { return value["id"].as_integer (); }
+
+        StringRef node_type () const
+        { return value["node type"].as_string (); }
+
+        StringRef description () const
+        { return value["description"].as_string (); }
+
+        // Name from either the node or the string table
+        StringRef name () const;
+
+        // Follow the edge with the given key to the node it refers to
+        Value follow (const char* key) const;
+    }; // class NodeView
+
+    // Nodes with a node type ending in _decl
+    class Declaration : public NodeView {
+    public:
+        using NodeView::NodeView;
+
+        static bool is (const Value& value);
+
+        Location location () const
+        { return get_location (value["location"]); }
+
+        Value context () const
+        { return follow ("context"); }
+
+        Value type () const
+        { return follow ("type"); }
+    }; // class Declaration
+
+    // Nodes with a node type ending in _type
+    class Type : public NodeView {
+    public:
+        using NodeView::NodeView;
+
+        static bool is (const Value& value);
+
+        Value declaration () const
+        { return follow ("declaration"); }
+
+        Value context () const
+        { return follow ("context"); }
+
+        bool is_complete () const
+        { return value["complete"].as_bool (); }
+
+        // Size in bits, or -1 if the size is not known
+        long long size () const
+        { return value["size"].as_integer (-1); }
+    }; // class Type
+
+    // Objects with kind gcc_macro
+    class Macro {
+    private:
+        Value value;
+
+    public:
+        Macro (const Value& value)
+            : value (value)
+            { }
+
+        static bool is (const Value& value);
+
+        const Value& get_value () const
+        { return value; }
+
+        StringRef name () const;
+
+        Location location () const
+        { return get_location (value["location"]); }
+
+        bool is_function_like () const
+        { return value["arguments"].is_array (); }
+
+        // Argument names, which may be string table indices; see
+        // Document::name
+        Value arguments () const
+        { return value["arguments"]; }
+
+        // Objects with kind gcc_macro_token
+        Value tokens () const
+        { return value["tokens"]; }
+    }; // class Macro
+
+} // namespace reader
+} // namespace treecreeper
+
+#endif // READER_VIEWS_H
@@ -0,0 +1,225 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#include <assert.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cbor_stream.h"
+
+namespace treecreeper {
+
+    // Initial bytes of some fixed items
+    static const char cbor_false = '\xf4';
+    static const char cbor_true = '\xf5';
+    static const char cbor_null = '\xf6';
+    static const char cbor_break = '\xff';
+    static const char cbor_indefinite_array = '\x9f';
+    static const char cbor_indefinite_map = '\xbf';
+
+    // Self-described CBOR tag (55799), which lets readers recognise the file
+    static const char cbor_magic[] = { '\xd9', '\xd9', '\xf7' };
+
+    // Tags for arbitrary precision integers
+    static const std::uint64_t positive_bignum_tag = 2;
+    static const std::uint64_t negative_bignum_tag = 3;
+
+    CBORStream::CBORStream (const char* const filename,
+                            const Compression& compression, bool records)
+        : OutputStream (filename, compression)
+    {
+        if (!records)
+            put (cbor_magic, sizeof (cbor_magic));
+    } // CBORStream::CBORStream
+
+    void CBORStream::close ()
+    {
+        assert (depth == 0);
+        OutputStream::close ();
+    } // CBORStream::close
+
+    void CBORStream::put_head (MajorType type, std::uint64_t value)
+    {
+        char head[9];
+        std::size_t length;
+        char major = char (type << 5);
+
+        if (value < 24) {
+            head[0] = major | char (value);
+            length = 1;
+        } else if (value <= 0xff) {
+            head[0] = major | 24;
+            length = 2;
+        } else if (value <= 0xffff) {
+            head[0] = major | 25;
+            length = 3;
+        } else if (value <= 0xffffffff) {
+            head[0] = major | 26;
+            length = 5;
+        } else {
+            head[0] = major | 27;
+            length = 9;
+        } // if
+
+        // Argument follows the initial byte in network byte order
+        for (std::size_t j = length - 1; j > 0; j--) {
+            head[j] = char (value & 0xff);
+            value >>= 8;
+        } // for
+        put (head, length);
+    } // CBORStream::put_head
+
+    void CBORStream::put_text (const char* value, std::size_t length)
+    {
+        put_head (TextString, length);
+        put (value, length);
+    } // CBORStream::put_text
+
+    void CBORStream::put_big_integer (const std::string& digits)
+    {
+        bool negative = digits[0] == '-';
+
+        // Convert decimal digits to big endian bytes
+        std::vector<unsigned char> bytes;
+        for (std::size_t j = negative ? 1 : 0; j < digits.size (); j++) {
+            unsigned int carry = digits[j] - '0';
+            for (auto it = bytes.rbegin (); it != bytes.rend (); ++it) {
+                carry += *it * 10u;
+                *it = carry & 0xff;
+                carry >>= 8;
+            } // for
+            if (carry)
+                bytes.insert (bytes.begin (), carry);
+        } // for
+
+        // Negative bignums encode -1 - n, so subtract one from the magnitude
+        if (negative) {
+            for (auto it = bytes.rbegin (); it != bytes.rend (); ++it) {
+                if ((*it)-- != 0)
+                    break;
+            } // for
+            while (bytes.size () > 1 && bytes.front () == 0)
+                bytes.erase (bytes.begin ());
+        } // if
+
+        put_head (Tag, negative ? negative_bignum_tag : positive_bignum_tag);
+        put_head (ByteString, bytes.size ());
+        put (reinterpret_cast<const char*> (bytes.data ()), bytes.size ());
+    } // CBORStream::put_big_integer
+
+    OutputStream& CBORStream::write_string (const char* value, std::size_t length)
+    {
+        put_text (value, length);
+        return *this;
+    } // CBORStream::write_string
+
+    void CBORStream::write_null ()
+    {
+        put (cbor_null);
+    } // CBORStream::write_null
+
+    void CBORStream::write_bool (bool value)
+    {
+        put (value ? cbor_true : cbor_false);
+    } // CBORStream::write_bool
+
+    void CBORStream::write_signed (long long value)
+    {
+        if (value < 0)
+            put_head (NegativeInteger, ~static_cast<std::uint64_t> (value));
+        else
+            put_head (UnsignedInteger, value);
+    } // CBORStream::write_signed
+
+    void CBORStream::write_unsigned (unsigned long long value)
+    {
+        put_head (UnsignedInteger, value);
+    } // CBORStream::write_unsigned
+
+    void CBORStream::write_raw (const JSONRawString& value)
+    {
+        // Raw strings are JSON tokens. Translate the ones the printers use
+        // (null and decimal integers) to native CBOR items.
+        const std::string& str = value.get_str_ref ();
+
+        if (str == "null") {
+            write_null ();
+            return;
+        } else if (str == "true" || str == "false") {
+            write_bool (str == "true");
+            return;
+        } // if
+
+        bool negative = !str.empty () && str[0] == '-';
+        std::size_t first_digit = negative ? 1 : 0;
+        bool is_integer = str.size () > first_digit;
+        for (std::size_t j = first_digit; j < str.size () && is_integer; j++)
+            is_integer = str[j] >= '0' && str[j] <= '9';
+
+        if (!is_integer) {
+            put_text (str.data (), str.size ());
+            return;
+        } // if
+
+        // Use a plain integer if the magnitude fits in 64 bits
+        std::uint64_t magnitude = 0;
+        bool overflow = false;
+        for (std::size_t j = first_digit; j < str.size () && !overflow; j++) {
+            unsigned int digit = str[j] - '0';
+            if (magnitude > (UINT64_MAX - digit) / 10)
+                overflow = true;
+            else
+                magnitude = magnitude * 10 + digit;
+        } // for
+
+        if (overflow)
+            put_big_integer (str);
+        else if (negative && magnitude > 0)
+            put_head (NegativeInteger, magnitude - 1);
+        else
+            put_head (UnsignedInteger, magnitude);
+    } // CBORStream::write_raw
+
+    void CBORStream::write_key (const char* name, std::size_t length)
+    {
+        put_text (name, length);
+    } // CBORStream::write_key
+
+    void CBORStream::write_key (const JSONKey& key)
+    {
+        put_text (key.name (), key.name_length ());
+    } // CBORStream::write_key
+
+    OutputStream& CBORStream::new_object (bool)
+    {
+        depth++;
+        put (cbor_indefinite_map);
+        block_opened ();
+        return *this;
+    } // CBORStream::new_object
+
+    OutputStream& CBORStream::new_array (bool)
+    {
+        depth++;
+        put (cbor_indefinite_array);
+        block_opened ();
+        return *this;
+    } // CBORStream::new_array
+
+    OutputStream& CBORStream::end_array ()
+    {
+        assert (depth > 0);
+        depth--;
+        put (cbor_break);
+        return *this;
+    } // CBORStream::end_array
+
+    OutputStream& CBORStream::end_object ()
+    {
+        assert (depth > 0);
+        depth--;
+        put (cbor_break);
+        return *this;
+    } // CBORStream::end_object
+
+} // namespace treecreeper
@@ -0,0 +1,63 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#ifndef CBOR_STREAM_H
+#define CBOR_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "output_stream.h"
+
+namespace treecreeper {
+
+    // Writes the output in Concise Binary Object Representation (RFC 7049).
+    // Objects and arrays are encoded as indefinite length maps and arrays,
+    // because their sizes are not known in advance.
+    class CBORStream final : public OutputStream {
+
+    private:
+
+        enum MajorType {
+            UnsignedInteger = 0,
+            NegativeInteger = 1,
+            ByteString = 2,
+            TextString = 3,
+            Array = 4,
+            Map = 5,
+            Tag = 6,
+            Simple = 7
+        };
+
+        int depth = 0;
+
+        void put_head (MajorType type, std::uint64_t value);
+        void put_text (const char* value, std::size_t length);
+        void put_big_integer (const std::string& digits);
+
+    protected:
+        void write_null () override;
+        void write_bool (bool value) override;
+        void write_signed (long long value) override;
+        void write_unsigned (unsigned long long value) override;
+        void write_raw (const JSONRawString& value) override;
+        void write_key (const char* name, std::size_t length) override;
+        void write_key (const JSONKey& key) override;
+
+    public:
+        // In records mode the stream is a CBOR sequence (RFC 8742) of top
+        // level items without the self-described CBOR tag.
+        CBORStream (const char* const filename,
+                    const Compression& compression = Compression (),
+                    bool records = false);
+        void close () override;
+
+        OutputStream& write_string (const char* value, std::size_t length) override;
+        OutputStream& new_object (bool compact = false) override;
+        OutputStream& new_array (bool compact = false) override;
+        OutputStream& end_array () override;
+        OutputStream& end_object () override;
+    }; // class CBORStream
+
+} // namespace treecreeper
+
+#endif // CBOR_STREAM_H
@@ -4,36 +4,108 @@
 #include <cstring>
 #include <iostream>
 #include <iomanip>
+#include <string>
+#include <vector>
 
 #include "interface.h"
+#include "trace.h"
 #include "traverse.h"
 
 #include "gcc-plugin.h"
 #include "plugin-version.h"
 #include "tree.h"
 #include "options.h"
+#include "timevar.h"
 
 int plugin_is_GPL_compatible;
 
+// Plugin events passed to visit_tree, with the names of their rows in the
+// -ftime-report timing report
+struct VisitorEvent {
+    const char* phase;
+    const char* timevar;
+};
+
+static VisitorEvent pre_genericize_event = {
+    "PRE_GENERICIZE", "treecreeper PRE_GENERICIZE"
+};
+static VisitorEvent finish_decl_event = {
+    "FINISH_DECL", "treecreeper FINISH_DECL"
+};
+static VisitorEvent finish_type_event = {
+    "FINISH_TYPE", "treecreeper FINISH_TYPE"
+};
+
+static bool parse_compression (const char* value);
+static void parse_list (const char* value, std::vector<std::string>& list);
 static void traverse_callback (void*, void* version);
-static void visitor_callback (void* t, void* phase);
+static void visitor_callback (void* t, void* event);
 
 namespace treecreeper {
     bool in_cxx;
 } // namespace treecreeper
 
+static bool
+parse_compression (const char* value)
+{
+    // Value is a method name, optionally followed by a colon and a level
+    using treecreeper::CompressionMethod;
+    auto& compression = treecreeper::options.compression;
+    const char* colon = std::strchr (value, ':');
+    std::string method (value, colon ? colon - value : std::strlen (value));
+
+    if (method == "none")
+        compression.method = CompressionMethod::None;
+    else if (method == "gzip")
+        compression.method = CompressionMethod::Gzip;
+    else if (method == "zstd")
+        compression.method = CompressionMethod::Zstd;
+    else
+        return false;
+
+    compression.level = treecreeper::Compression::default_level;
+    if (colon) {
+        char* end;
+        compression.level = std::strtol (colon + 1, &end, 10);
+        if (*end || end == colon + 1)
+            return false;
+    } // if
+
+    if (!treecreeper::compression_supported (compression.method)) {
+        std::cerr << "treecreeper: Compression method " << method
+                  << " is not supported by this build\n";
+        std::exit (1);
+    } // if
+    return true;
+} // parse_compression
+
 static void
-visitor_callback (void* t, void* phase)
+parse_list (const char* value, std::vector<std::string>& list)
 {
-    const char* phase_name = static_cast<const char*> (phase);
-    std::cout << phase_name << ": ";
-    treecreeper::visit_tree (static_cast<const_tree> (t));
+    // Comma separated, empty items are ignored
+    while (*value) {
+        const char* end = std::strchr (value, ',');
+        std::size_t length = end ? end - value : std::strlen (value);
+        if (length > 0)
+            list.emplace_back (value, length);
+        value += end ? length + 1 : length;
+    } // while
+} // parse_list
+
+static void
+visitor_callback (void* t, void* event)
+{
+    auto& visitor_event = *static_cast<VisitorEvent*> (event);
+    auto_client_timevar timevar (visitor_event.timevar);
+    treecreeper::visit_tree (static_cast<const_tree> (t), visitor_event.phase);
 } // visitor_callback
 
 static void
 traverse_callback (void*, void* version)
 {
-    std::cout << "Finished unit!\n";
+    if (treecreeper::verbose (treecreeper::VERBOSE_PHASES))
+        treecreeper::trace () << "treecreeper: Finished unit\n";
+    auto_client_timevar timevar ("treecreeper output");
     treecreeper::print_whole_tree (static_cast<plugin_gcc_version*> (version));
 } // traverse_callback
 
@@ -58,13 +130,126 @@ plugin_init (plugin_name_args* args,
 #endif // !DEBUG
 
     treecreeper::options.builtins = false;
+    treecreeper::options.records = false;
+    treecreeper::options.format = treecreeper::OutputFormat::JSON;
+    treecreeper::options.fields = treecreeper::FIELD_ALL;
+    treecreeper::options.locations = treecreeper::LocationFormat::Table;
+    treecreeper::options.strings = treecreeper::StringFormat::Inline;
+    treecreeper::options.layout = treecreeper::Layout::Tree;
+    treecreeper::options.ids = treecreeper::IdFormat::Sequential;
+    treecreeper::options.system_headers = true;
+    treecreeper::options.verbose = treecreeper::VERBOSE_SILENT;
 
+    bool index = false;
+    bool locations_given = false;
     for (int j = 0; j < args->argc; j++)
         {
             plugin_argument& arg = args->argv[j];
             if (!std::strcmp (arg.key, "output") && arg.value)
                 treecreeper::options.output_file = arg.value;
-            else if (!std::strcmp (arg.key, "builtins")
+            else if (!std::strcmp (arg.key, "format") && arg.value) {
+                if (!std::strcmp (arg.value, "json"))
+                    treecreeper::options.format = treecreeper::OutputFormat::JSON;
+                else if (!std::strcmp (arg.value, "cbor"))
+                    treecreeper::options.format = treecreeper::OutputFormat::CBOR;
+                else {
+                    std::cerr << "treecreeper: Unknown output format " << arg.value
+                              << " (use json or cbor)\n";
+                    std::exit (1);
+                } // if
+            } else if (!std::strcmp (arg.key, "compress") && arg.value) {
+                if (!parse_compression (arg.value)) {
+                    std::cerr << "treecreeper: Bad compression " << arg.value
+                              << " (use none, gzip[:level] or zstd[:level])\n";
+                    std::exit (1);
+                } // if
+            } else if (!std::strcmp (arg.key, "fields") && arg.value) {
+                if (!treecreeper::parse_fields (arg.value)) {
+                    std::cerr << "treecreeper: Bad field list " << arg.value << "\n";
+                    std::exit (1);
+                } // if
+            } else if (!std::strcmp (arg.key, "locations") && arg.value) {
+                locations_given = true;
+                if (!std::strcmp (arg.value, "table"))
+                    treecreeper::options.locations = treecreeper::LocationFormat::Table;
+                else if (!std::strcmp (arg.value, "inline"))
+                    treecreeper::options.locations = treecreeper::LocationFormat::Inline;
+                else {
+                    std::cerr << "treecreeper: Unknown location format " << arg.value
+                              << " (use table or inline)\n";
+                    std::exit (1);
+                } // if
+            } else if (!std::strcmp (arg.key, "strings") && arg.value) {
+                if (!std::strcmp (arg.value, "inline"))
+                    treecreeper::options.strings = treecreeper::StringFormat::Inline;
+                else if (!std::strcmp (arg.value, "table"))
+                    treecreeper::options.strings = treecreeper::StringFormat::Table;
+                else {
+                    std::cerr << "treecreeper: Unknown string format " << arg.value
+                              << " (use inline or table)\n";
+                    std::exit (1);
+                } // if
+            } else if (!std::strcmp (arg.key, "layout") && arg.value) {
+                if (!std::strcmp (arg.value, "tree"))
+                    treecreeper::options.layout = treecreeper::Layout::Tree;
+                else if (!std::strcmp (arg.value, "flat"))
+                    treecreeper::options.layout = treecreeper::Layout::Flat;
+                else {
+                    std::cerr << "treecreeper: Unknown layout " << arg.value
+                              << " (use tree or flat)\n";
+                    std::exit (1);
+                } // if
+            } else if (!std::strcmp (arg.key, "ids") && arg.value) {
+                if (!std::strcmp (arg.value, "sequential"))
+                    treecreeper::options.ids = treecreeper::IdFormat::Sequential;
+                else if (!std::strcmp (arg.value, "stable"))
+                    treecreeper::options.ids = treecreeper::IdFormat::Stable;
+                else {
+                    std::cerr << "treecreeper: Unknown id format " << arg.value
+                              << " (use sequential or stable)\n";
+                    std::exit (1);
+                } // if
+            } else if (!std::strcmp (arg.key, "include") && arg.value)
+                parse_list (arg.value, treecreeper::options.include_files);
+            else if (!std::strcmp (arg.key, "exclude") && arg.value)
+                parse_list (arg.value, treecreeper::options.exclude_files);
+            else if (!std::strcmp (arg.key, "namespaces") && arg.value)
+                parse_list (arg.value, treecreeper::options.include_namespaces);
+            else if (!std::strcmp (arg.key, "exclude_namespaces") && arg.value)
+                parse_list (arg.value, treecreeper::options.exclude_namespaces);
+            else if (!std::strcmp (arg.key, "roots") && arg.value)
+                parse_list (arg.value, treecreeper::options.roots);
+            else if (!std::strcmp (arg.key, "system_headers") && arg.value) {
+                if (!std::strcmp (arg.value, "yes"))
+                    treecreeper::options.system_headers = true;
+                else if (!std::strcmp (arg.value, "no"))
+                    treecreeper::options.system_headers = false;
+                else {
+                    std::cerr << "treecreeper: Bad system_headers value " << arg.value
+                              << " (use yes or no)\n";
+                    std::exit (1);
+                } // if
+            } else if (!std::strcmp (arg.key, "verbose")) {
+                char* end = nullptr;
+                if (arg.value)
+                    treecreeper::options.verbose = std::strtol (arg.value, &end, 10);
+                else
+                    treecreeper::options.verbose = treecreeper::VERBOSE_PHASES;
+                if (end && (*end || end == arg.value)) {
+                    std::cerr << "treecreeper: Bad verbosity level " << arg.value << "\n";
+                    std::exit (1);
+                } // if
+            } else if (!std::strcmp (arg.key, "stats") && arg.value)
+                treecreeper::options.stats_file = arg.value;
+            else if (!std::strcmp (arg.key, "index")) {
+                // Default name is derived from the output file below
+                index = true;
+                if (arg.value)
+                    treecreeper::options.index_file = arg.value;
+            } else if (!std::strcmp (arg.key, "records")
+                       && (!arg.value || !std::strcmp (arg.value, "true"))) {
+                treecreeper::options.records = true;
+            } else if (!std::strcmp (arg.key, "builtins")
                      && (!arg.value || std::strcmp (arg.value, "true")))
                 treecreeper::options.builtins = true;
             else
@@ -77,6 +262,24 @@ plugin_init (plugin_name_args* args,
         std::exit (1);
     } // if
 
+    // File table indices depend on what the unit includes, so stable ids
+    // come with inline locations unless table locations are asked for
+    if (treecreeper::options.ids == treecreeper::IdFormat::Stable && !locations_given)
+        treecreeper::options.locations = treecreeper::LocationFormat::Inline;
+
+    if (index && treecreeper::options.index_file.empty ())
+        treecreeper::options.index_file = treecreeper::options.output_file + ".idx";
+
+    if (treecreeper::options.records
+        && treecreeper::options.layout == treecreeper::Layout::Flat) {
+        std::cerr << "treecreeper: Records mode supports only the tree layout\n";
+        std::exit (1);
+    } // if
+
+    // Records mode writes declarations as soon as they are finished
+    if (treecreeper::options.records)
+        treecreeper::open_records (version);
+
     // Disable assembly output.
     asm_file_name = HOST_BIT_BUCKET;
 
@@ -90,16 +293,16 @@ plugin_init (plugin_name_args* args,
     register_callback (base_name,
                        PLUGIN_PRE_GENERICIZE,
                        visitor_callback,
-                       (void*) "PRE_GENERICIZE");
+                       &pre_genericize_event);
 
     register_callback (base_name,
                        PLUGIN_FINISH_DECL,
                        visitor_callback,
-                       (void*) "FINISH_DECL");
+                       &finish_decl_event);
 
     register_callback (base_name,
                        PLUGIN_FINISH_TYPE,
                        visitor_callback,
-                       (void*) "FINISH_TYPE");
+                       &finish_type_event);
     return 0;
 } // plugin_init
@@ -1,34 +1,40 @@
 // -*- mode: c++; c-basic-offset: 4 -*-
 
+#include <algorithm>
 #include <assert.h>
-#include <fstream>
-#include <iomanip>
-#include <stdexcept>
-#include <sstream>
 #include <string>
 #include <type_traits>
 #include <vector>
 
+#if defined (__AVX2__)
+#include <immintrin.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "json_stream.h"
 
 namespace treecreeper {
 
-    static std::string quote_json_string (const char* const value);
+    static std::size_t clean_prefix_length (const char* value, std::size_t length);
 
-    JSONStream::JSONStream (const char* const filename)
-    {
-        assert (filename);
+    // Block of spaces used for indentation, so that we don't need to write
+    // spaces one by one.
+    static const char padding[] =
+        "                                                                "
+        "                                                                ";
 
-        stream.exceptions (std::ofstream::failbit | std::ofstream::badbit);
-        stream.open (filename, std::ofstream::trunc);
-    } // JSONStream::JSONStream
+    JSONStream::JSONStream (const char* const filename,
+                            const Compression& compression, bool records)
+        : OutputStream (filename, compression), records (records)
+    { }
 
     void JSONStream::close ()
     {
         assert (context () == InRoot);
         if (state != NewStream)
-            stream << std::endl;
-        stream.close ();
+            put ('\n');
+        OutputStream::close ();
     } // JSONStream::close
 
     void JSONStream::new_item ()
@@ -39,19 +45,27 @@ namespace treecreeper {
                                      || state == AfterValue))
                 || (ctx == InArray
                     && (state == AfterBracket || state == AfterValue))
-                || (ctx == InRoot && state == NewStream)
+                || (ctx == InRoot && (state == NewStream
+                                      || (records && state == AfterValue)))
                 || (ctx != InRoot && state != NewStream));
 
         if (state == NewStream)
             return; // Don't add extra spaces in the beginning of file
-        else if (state == AfterValue) {
+        else if (ctx == InRoot) {
+            // Records are separated by newlines
+            put ('\n');
+            return;
+        } else if (state == AfterValue) {
             // Separate values/fields by commas in arrays and objects
-            stream << ',';
+            put (',');
         } // if
 
-        // Put space or newline after comma, bracket or brace
-        if (state == AfterColon || compact ())
-            stream << ' ';
+        // Put space or newline after comma, bracket or brace. Records are
+        // written without any spaces.
+        if (records)
+            return;
+        else if (state == AfterColon || compact ())
+            put (' ');
         else
             newline_and_indent ();
     } // JSONStream::new_item
@@ -62,90 +76,101 @@ namespace treecreeper {
 
         contexts.pop_back ();
 
-        if (state == AfterBrace || state == AfterBracket || compact ())
-            stream << ' ';
+        if (records)
+            ; // No spaces in records
+        else if (state == AfterBrace || state == AfterBracket || compact ())
+            put (' ');
         else
             newline_and_indent ();
 
-        stream << c;
+        put (c);
         compactness.pop_back ();
         state = AfterValue;
     } // JSONStream::close_block
 
     void JSONStream::newline_and_indent ()
     {
-        stream << std::endl;
-        for (auto j = (contexts.size () - 1) * indentation; j > 0; j--)
-            stream << ' ';
+        put ('\n');
+        for (std::size_t j = (contexts.size () - 1) * indentation; j > 0; ) {
+            std::size_t chunk = std::min (j, sizeof (padding) - 1);
+            put (padding, chunk);
+            j -= chunk;
+        } // for
     } // JSONStream::newline_and_indent
 
-    JSONStream& JSONStream::operator<< (const char* const value)
+    OutputStream& JSONStream::write_string (const char* value, std::size_t length)
     {
-        if (value)
-            return write_raw_value (quote_json_string (value).c_str ());
-        else
-            return write_raw_value ("null");
-    } // JSONStream::operator<<
+        assert (context () != InObject || state == AfterColon);
+        new_item ();
+        put_quoted (value, length);
+        state = AfterValue;
+        return *this;
+    } // JSONStream::write_string
 
-    JSONStream& JSONStream::operator<< (const std::string& value)
+    void JSONStream::write_null ()
     {
-        return *this << value.c_str();
-    } // JSONStream::operator<<
+        write_raw_value ("null", 4);
+    } // JSONStream::write_null
 
-    JSONStream& JSONStream::operator<< (const std::string&& value)
+    void JSONStream::write_bool (bool value)
     {
-        return *this << value.c_str();
-    } // JSONStream::operator<<
-  
-    JSONStream& JSONStream::operator<< (bool value)
-    {
-        return write_raw_value (value ? "true" : "false");
-    } // JSONStream::operator<<
+        if (value)
+            write_raw_value ("true", 4);
+        else
+            write_raw_value ("false", 5);
+    } // JSONStream::write_bool
 
-    JSONStream& JSONStream::operator<< (const JSONRawString& value)
+    void JSONStream::write_raw (const JSONRawString& value)
     {
-        return write_raw_value (value.get_str_ref ().c_str ());
-    } // JSONStream::operator<<
+        const std::string& str = value.get_str_ref ();
+        write_raw_value (str.data (), str.size ());
+    } // JSONStream::write_raw
 
-    JSONStream& JSONStream::operator<< (const JSONRawString&& value)
+    void JSONStream::write_key (const char* name, std::size_t length)
     {
-        return *this << value;
-    } // JSONStream::operator<<
+        assert (name);
+        assert (context () == InObject
+                && (state == AfterBrace || state == AfterValue));
+        new_item ();
+        put_quoted (name, length);
+        put (':');
+        state = AfterColon;
+    } // JSONStream::write_key
 
-    JSONStream& JSONStream::operator[] (const char* const name)
+    void JSONStream::write_key (const JSONKey& key)
     {
-        assert (name);
         assert (context () == InObject
                 && (state == AfterBrace || state == AfterValue));
         new_item ();
-        stream << quote_json_string (name) << ':';
+        put (key.quoted (), key.quoted_length ());
         state = AfterColon;
-        return *this;
-    } // JSONStream::operator[]
+    } // JSONStream::write_key
 
-    JSONStream& JSONStream::new_object (bool compact)
+    OutputStream& JSONStream::new_object (bool compact)
     {
         assert (context () != InObject || state != AfterBrace);
         new_item ();
-        stream << '{';
+        put ('{');
+        block_opened ();
         state = AfterBrace;
         contexts.push_back (InObject);
         compactness.push_back (compact);
         return *this;
     } // JSONStream::new_object
 
-    JSONStream& JSONStream::new_array (bool compact)
+    OutputStream& JSONStream::new_array (bool compact)
     {
         assert (context () != InObject || state != AfterBrace);
         new_item ();
-        stream << '[';
+        put ('[');
+        block_opened ();
         state = AfterBracket;
         contexts.push_back (InArray);
         compactness.push_back (compact);
         return *this;
     } // JSONStream::new_array
   
-    JSONStream& JSONStream::end_array ()
+    OutputStream& JSONStream::end_array ()
     {
         assert (context () == InArray
                 && (state == AfterValue || state == AfterBracket));
@@ -153,7 +178,7 @@ namespace treecreeper {
         return *this;
     } // JSONStream::end_array
 
-    JSONStream& JSONStream::end_object ()
+    OutputStream& JSONStream::end_object ()
     {
         assert (context () == InObject
                 && (state == AfterValue || state == AfterBrace));
@@ -161,53 +186,102 @@ namespace treecreeper {
         return *this;
     } // JSONStream::end_object
 
-    std::string quote_json_string (const char* const value)
-    {
-        if (!value)
-            std::abort ();
-
-        std::stringstream ss;
-        ss << std::setfill('0') << std::hex << '"';
-
-        for (int j = 0; value[j] != 0; j++)
-            {
-                char c = value[j];
-
-                if (c < 0x20) { // Control characters
-                    switch (c) {
-                    case '\a':
-                        ss << "\\a";
-                        break;
-                    case '\b':
-                        ss << "\\b";
-                        break;
-                    case '\t':
-                        ss << "\\t";
-                        break;
-                    case '\n':
-                        ss << "\\n";
-                        break;
-                    case '\f':
-                        ss << "\\f";
-                        break;
-                    case '\r':
-                        ss << "\\r";
-                        break;
-                    default:
-                        // Use unicode escape
-                        ss << "\\u" << std::setw (4) << int (c);
-                    } // switch
-                } else if (c == '\\')
-                    ss << "\\\\";
-                else if (c == '"')
-                    ss << "\\\"";
-                else
-                    ss << c;
-            } // for
-        ss << '"';
-        return ss.str ();
-    } // json_quote_string
-
-    const JSONRawString Null ("null");
+    std::size_t clean_prefix_length (const char* value, std::size_t length)
+    {
+        // Find the first byte which needs escaping: a quote, a backslash or
+        // a control character. Scan as many bytes as possible at once.
+        std::size_t j = 0;
+
+#if defined (__AVX2__)
+        const __m256i quote32 = _mm256_set1_epi8 ('"');
+        const __m256i backslash32 = _mm256_set1_epi8 ('\\');
+        const __m256i control32 = _mm256_set1_epi8 (0x1f);
+
+        for (; j + 32 <= length; j += 32) {
+            __m256i v = _mm256_loadu_si256
+                (reinterpret_cast<const __m256i*> (value + j));
+            __m256i special = _mm256_or_si256
+                (_mm256_or_si256 (_mm256_cmpeq_epi8 (v, quote32),
+                                  _mm256_cmpeq_epi8 (v, backslash32)),
+                 _mm256_cmpeq_epi8 (_mm256_min_epu8 (v, control32), v));
+            unsigned int mask = _mm256_movemask_epi8 (special);
+            if (mask)
+                return j + __builtin_ctz (mask);
+        } // for
+#endif // __AVX2__
+
+#if defined (__SSE2__)
+        const __m128i quote16 = _mm_set1_epi8 ('"');
+        const __m128i backslash16 = _mm_set1_epi8 ('\\');
+        const __m128i control16 = _mm_set1_epi8 (0x1f);
+
+        for (; j + 16 <= length; j += 16) {
+            __m128i v = _mm_loadu_si128
+                (reinterpret_cast<const __m128i*> (value + j));
+            __m128i special = _mm_or_si128
+                (_mm_or_si128 (_mm_cmpeq_epi8 (v, quote16),
+                               _mm_cmpeq_epi8 (v, backslash16)),
+                 _mm_cmpeq_epi8 (_mm_min_epu8 (v, control16), v));
+            unsigned int mask = _mm_movemask_epi8 (special);
+            if (mask)
+                return j + __builtin_ctz (mask);
+        } // for
+#endif // __SSE2__
+
+        for (; j < length; j++) {
+            unsigned char c = value[j];
+            if (c < 0x20 || c == '"' || c == '\\')
+                break;
+        } // for
+        return j;
+    } // clean_prefix_length
+
+    void JSONStream::put_quoted (const char* value, std::size_t length)
+    {
+        static const char hex_digits[] = "0123456789abcdef";
+
+        put ('"');
+        while (length > 0) {
+            // Copy the run of characters not needing escapes in bulk
+            std::size_t clean = clean_prefix_length (value, length);
+            put (value, clean);
+            if (clean == length)
+                break;
+
+            unsigned char c = value[clean];
+            value += clean + 1;
+            length -= clean + 1;
+
+            switch (c) {
+            case '"':
+                put ("\\\"", 2);
+                break;
+            case '\\':
+                put ("\\\\", 2);
+                break;
+            case '\b':
+                put ("\\b", 2);
+                break;
+            case '\t':
+                put ("\\t", 2);
+                break;
+            case '\n':
+                put ("\\n", 2);
+                break;
+            case '\f':
+                put ("\\f", 2);
+                break;
+            case '\r':
+                put ("\\r", 2);
+                break;
+            default:
+                // Use unicode escape for other control characters
+                char escape[] = { '\\', 'u', '0', '0',
+                                  hex_digits[c >> 4], hex_digits[c & 0xf] };
+                put (escape, sizeof (escape));
+            } // switch
+        } // while
+        put ('"');
+    } // JSONStream::put_quoted
 
 } // namespace treecreeper
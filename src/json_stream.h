@@ -4,16 +4,16 @@
 #define JSON_STREAM_H
 
 #include <assert.h>
-#include <fstream>
-#include <string>
+#include <cstddef>
+#include <cstring>
 #include <type_traits>
 #include <vector>
 
-namespace treecreeper {
+#include "output_stream.h"
 
-    class JSONRawString;
+namespace treecreeper {
 
-    class JSONStream final {
+    class JSONStream final : public OutputStream {
 
     private:
 
@@ -35,89 +35,81 @@ namespace treecreeper {
         StreamState state = NewStream;
         std::vector<StreamContext> contexts = { InRoot };
         std::vector<bool> compactness;
-        std::ofstream stream;
         int indentation = 4;
+        bool records;
 
         StreamContext context () const
         { return contexts.back (); }
 
         bool compact () const
-        { return compactness.back (); }
+        { return records || compactness.back (); }
 
         void new_item ();
         void close_block (char c);
         void newline_and_indent ();
+        void put_quoted (const char* value, std::size_t length);
 
-        template <typename T> JSONStream&
-            write_raw_value (T value)
+        void write_raw_value (const char* value, std::size_t length)
         {
             assert (context () != InObject || state == AfterColon);
             new_item ();
-            stream << value;
+            put (value, length);
             state = AfterValue;
-            return *this;
         } // write_raw_value
 
-    public:
-        JSONStream (const char* const filename);
-        JSONStream (const JSONStream&) = delete;
-        void close ();
-
-        JSONStream& operator<< (const char* const value);
-        JSONStream& operator<< (const unsigned char* const value)
-        { return *this << reinterpret_cast<const char* const> (value); }
-
-        JSONStream& operator<< (const std::string& value);
-        JSONStream& operator<< (const std::string&& value);
-        JSONStream& operator<< (bool value);
-        JSONStream& operator<< (const JSONRawString& value);
-        JSONStream& operator<< (const JSONRawString&& value);
-        JSONStream& operator[] (const char* const name);
-
-        JSONStream& operator<< (int value)
-        { return write_raw_value (value); }
-        JSONStream& operator<< (unsigned int value)
-        { return write_raw_value (value); }
-
-        JSONStream& operator<< (long value)
-        { return write_raw_value (value); }
-        JSONStream& operator<< (unsigned long value)
-        { return write_raw_value (value); }
-
-        JSONStream& operator<< (long long value)
-        { return write_raw_value (value); }
-        JSONStream& operator<< (unsigned long long value)
-        { return write_raw_value (value); }
-
-        JSONStream& new_object (bool compact = false);
-        JSONStream& new_array (bool compact = false);
-        JSONStream& end_array ();
-        JSONStream& end_object ();
-    }; // class JSONStream
+        void write_raw_value (const char* value)
+        { write_raw_value (value, std::strlen (value)); }
 
-    class JSONRawString final {
-    private:
-        std::string str;
+        template <typename T> void
+            write_integer (T value)
+        {
+            static_assert (std::is_integral<T>::value, "Integer type expected");
+
+            // Format digits backwards to the end of a local buffer
+            char digits[3 * sizeof (T) + 2];
+            char* end = digits + sizeof (digits);
+            char* begin = end;
+            bool negative = value < 0;
+            typename std::make_unsigned<T>::type n = value;
+            if (negative)
+                n = -n;
+
+            do {
+                *--begin = '0' + n % 10;
+                n /= 10;
+            } while (n);
+
+            if (negative)
+                *--begin = '-';
+            write_raw_value (begin, end - begin);
+        } // write_integer
+
+    protected:
+        void write_null () override;
+        void write_bool (bool value) override;
+        void write_raw (const JSONRawString& value) override;
+        void write_key (const char* name, std::size_t length) override;
+        void write_key (const JSONKey& key) override;
+
+        void write_signed (long long value) override
+        { write_integer (value); }
+        void write_unsigned (unsigned long long value) override
+        { write_integer (value); }
 
     public:
-        JSONRawString (const std::string& value)
-            : str (value)
-            { }
-
-        JSONRawString (const char* const value)
-            : str (value)
-            { }
-
-        JSONRawString (const JSONRawString& value)
-            : str (value.str)
-            { }
-                
-        const std::string& get_str_ref () const
-        { return str; }
-
-    }; // class JSONRawString
-
-    extern const JSONRawString Null;
+        // In records mode the stream holds any number of top level values,
+        // each written on its own line (newline delimited JSON).
+        JSONStream (const char* const filename,
+                    const Compression& compression = Compression (),
+                    bool records = false);
+        void close () override;
+
+        OutputStream& write_string (const char* value, std::size_t length) override;
+        OutputStream& new_object (bool compact = false) override;
+        OutputStream& new_array (bool compact = false) override;
+        OutputStream& end_array () override;
+        OutputStream& end_object () override;
+    }; // class JSONStream
 
 } // namespace treecreeper
 
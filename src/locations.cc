@@ -0,0 +1,67 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#include <climits>
+
+#include "locations.h"
+
+namespace treecreeper {
+
+    // Number of cached locations, must be a power of two
+    static const unsigned int location_cache_size = 1 << 12;
+
+    struct CachedLocation {
+        source_location loc;    // Reserved locations mark empty slots
+        expanded_location xloc;
+    }; // struct CachedLocation
+
+    static CachedLocation location_cache[location_cache_size];
+
+    // Index of the ordinary map which resolved the previous location. The
+    // index stays valid when the line table grows, a pointer would not.
+    static unsigned int last_map_index = UINT_MAX;
+
+    static const line_map_ordinary*
+    find_ordinary_map (source_location loc)
+    {
+        unsigned int used = LINEMAPS_ORDINARY_USED (line_table);
+        if (last_map_index < used) {
+            auto map = LINEMAPS_ORDINARY_MAP_AT (line_table, last_map_index);
+            source_location end = last_map_index + 1 < used
+                ? MAP_START_LOCATION (LINEMAPS_ORDINARY_MAP_AT (line_table,
+                                                                last_map_index + 1))
+                : UINT_MAX;
+            if (loc >= MAP_START_LOCATION (map) && loc < end)
+                return map;
+        } // if
+
+        auto map = linemap_check_ordinary (linemap_lookup (line_table, loc));
+        last_map_index = map - LINEMAPS_ORDINARY_MAPS (line_table);
+        return map;
+    } // find_ordinary_map
+
+    expanded_location
+    resolve_location (source_location loc)
+    {
+        loc = LOCATION_LOCUS (loc);
+        if (loc < RESERVED_LOCATION_COUNT)
+            return expand_location (loc);
+
+        auto& cached = location_cache[loc & (location_cache_size - 1)];
+        if (cached.loc == loc)
+            return cached.xloc;
+        cached.loc = loc;
+
+        // Macro locations resolve to the expansion point, like in
+        // expand_location
+        const line_map_ordinary* map;
+        if (linemap_location_from_macro_expansion_p (line_table, loc))
+            loc = linemap_resolve_location (line_table, loc,
+                                            LRK_MACRO_EXPANSION_POINT, &map);
+        else
+            map = find_ordinary_map (loc);
+
+        cached.xloc = linemap_expand_location (line_table, map, loc);
+        return cached.xloc;
+    } // resolve_location
+
+} // namespace treecreeper
@@ -0,0 +1,21 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#ifndef LOCATIONS_H
+#define LOCATIONS_H
+
+#include "gcc-plugin.h"
+#include "config.h"
+#include "system.h"
+#include "coretypes.h"
+#include "input.h"
+
+namespace treecreeper {
+
+    // Same as expand_location, but cached. Declarations are mostly visited
+    // in source order, so consecutive locations tend to fall into the same
+    // line map, which is tried before searching the line table.
+    expanded_location resolve_location (source_location loc);
+
+} // namespace treecreeper
+
+#endif // LOCATIONS_H
@@ -0,0 +1,82 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#include <cstdint>
+#include <cstring>
+
+#include "node_table.h"
+
+namespace treecreeper {
+
+    // Initial number of slots, must be a power of two
+    static const std::size_t initial_capacity = 1 << 16;
+
+    NodeTable::NodeTable ()
+        : capacity (initial_capacity)
+    {
+        entries = new NodeEntry[capacity];
+        std::memset (entries, 0, capacity * sizeof (NodeEntry));
+    } // NodeTable::NodeTable
+
+    NodeTable::~NodeTable ()
+    {
+        delete[] entries;
+    } // NodeTable::~NodeTable
+
+    std::size_t NodeTable::slot_of (const void* node) const
+    {
+        // Tree nodes are aligned, so drop the low bits and spread the rest
+        // with a Fibonacci hash.
+        auto hash = (reinterpret_cast<std::uintptr_t> (node) >> 3)
+            * UINT64_C (0x9e3779b97f4a7c15);
+        return (hash >> 32) & (capacity - 1);
+    } // NodeTable::slot_of
+
+    void NodeTable::grow ()
+    {
+        NodeEntry* old_entries = entries;
+        std::size_t old_capacity = capacity;
+
+        capacity *= 2;
+        entries = new NodeEntry[capacity];
+        std::memset (entries, 0, capacity * sizeof (NodeEntry));
+
+        for (std::size_t j = 0; j < old_capacity; j++) {
+            if (!old_entries[j].node)
+                continue;
+            std::size_t slot = slot_of (old_entries[j].node);
+            while (entries[slot].node)
+                slot = (slot + 1) & (capacity - 1);
+            entries[slot] = old_entries[j];
+        } // for
+        delete[] old_entries;
+    } // NodeTable::grow
+
+    NodeEntry& NodeTable::get (const void* node)
+    {
+        // Keep the load factor at most one half
+        if (2 * (used + 1) > capacity)
+            grow ();
+
+        std::size_t slot = slot_of (node);
+        while (entries[slot].node && entries[slot].node != node)
+            slot = (slot + 1) & (capacity - 1);
+
+        if (!entries[slot].node) {
+            entries[slot].node = node;
+            used++;
+        } // if
+        return entries[slot];
+    } // NodeTable::get
+
+    const NodeEntry* NodeTable::find (const void* node) const
+    {
+        std::size_t slot = slot_of (node);
+        while (entries[slot].node) {
+            if (entries[slot].node == node)
+                return &entries[slot];
+            slot = (slot + 1) & (capacity - 1);
+        } // while
+        return nullptr;
+    } // NodeTable::find
+
+} // namespace treecreeper
@@ -0,0 +1,59 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#ifndef NODE_TABLE_H
+#define NODE_TABLE_H
+
+#include <cstddef>
+
+namespace treecreeper {
+
+    // Bookkeeping of a single tree node
+    struct NodeEntry {
+        const void* node;               // Null for empty slots
+        unsigned int id : 30;           // Zero until the node has been given an id
+        unsigned int visited : 1;       // True when the node has been printed in full
+        unsigned int incomplete : 1;    // True if the node was printed unfinished
+        unsigned int location;          // Source location, used for ordering
+    }; // struct NodeEntry
+
+    // Table of nodes keyed by their address. Entries live in one flat array
+    // with linear probing, so finding or adding a node takes a single probe
+    // sequence and no allocation, unless the table needs to grow.
+    class NodeTable {
+
+    private:
+        NodeEntry* entries = nullptr;
+        std::size_t capacity = 0;
+        std::size_t used = 0;
+
+        void grow ();
+        std::size_t slot_of (const void* node) const;
+
+    public:
+        NodeTable ();
+        NodeTable (const NodeTable&) = delete;
+        ~NodeTable ();
+
+        // Find the entry of a node or add an empty one. The reference is
+        // valid until the next call to get.
+        NodeEntry& get (const void* node);
+
+        // Find the entry of a node or return null
+        const NodeEntry* find (const void* node) const;
+
+        std::size_t size () const
+        { return used; }
+
+        // Call func for each entry in unspecified order
+        template <typename Func> void for_each (Func func) const
+        {
+            for (std::size_t j = 0; j < capacity; j++) {
+                if (entries[j].node)
+                    func (entries[j]);
+            } // for
+        } // for_each
+    }; // class NodeTable
+
+} // namespace treecreeper
+
+#endif // NODE_TABLE_H
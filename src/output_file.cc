@@ -0,0 +1,240 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#include <assert.h>
+#include <cerrno>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif // HAVE_ZLIB
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif // HAVE_ZSTD
+
+#include "output_file.h"
+
+namespace treecreeper {
+
+    // Size of the buffer for compressed data
+    static const std::size_t compressed_buffer_size = 1 << 18;
+
+    OutputFile::OutputFile (const char* const filename)
+        : filename (filename)
+    {
+        assert (filename);
+
+        fd = ::open (filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd < 0)
+            throw std::system_error (errno, std::generic_category (), filename);
+    } // OutputFile::OutputFile
+
+    OutputFile::~OutputFile ()
+    {
+        if (fd >= 0)
+            ::close (fd);
+    } // OutputFile::~OutputFile
+
+    void OutputFile::write (const char* data, std::size_t length)
+    {
+        write_fully (data, length);
+    } // OutputFile::write
+
+    void OutputFile::write_fully (const char* data, std::size_t length)
+    {
+        while (length > 0) {
+            ssize_t written = ::write (fd, data, length);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error (errno, std::generic_category (), filename);
+            } // if
+            data += written;
+            length -= written;
+        } // while
+    } // OutputFile::write_fully
+
+    void OutputFile::close ()
+    {
+        int result = ::close (fd);
+        fd = -1;
+        if (result < 0)
+            throw std::system_error (errno, std::generic_category (), filename);
+    } // OutputFile::close
+
+#ifdef HAVE_ZLIB
+
+    // Writes a gzip stream with zlib
+    class GzipFile final : public OutputFile {
+
+    private:
+        z_stream zs;
+        std::unique_ptr<char[]> buffer;
+
+        void deflate_all (int flush);
+
+    public:
+        GzipFile (const char* const filename, int level);
+        ~GzipFile ();
+
+        void write (const char* data, std::size_t length) override;
+        void close () override;
+    }; // class GzipFile
+
+    GzipFile::GzipFile (const char* const filename, int level)
+        : OutputFile (filename), buffer (new char[compressed_buffer_size])
+    {
+        zs.zalloc = Z_NULL;
+        zs.zfree = Z_NULL;
+        zs.opaque = Z_NULL;
+
+        // Window bits over 15 make zlib write a gzip header and trailer. On
+        // failure zlib frees its state itself, and the members are
+        // destroyed as the constructor throws.
+        if (level == Compression::default_level)
+            level = Z_DEFAULT_COMPRESSION;
+        if (deflateInit2 (&zs, level, Z_DEFLATED, 15 + 16, 8,
+                          Z_DEFAULT_STRATEGY) != Z_OK)
+            throw std::runtime_error ("Could not initialise gzip compression");
+    } // GzipFile::GzipFile
+
+    GzipFile::~GzipFile ()
+    {
+        deflateEnd (&zs);
+    } // GzipFile::~GzipFile
+
+    void GzipFile::deflate_all (int flush)
+    {
+        int result;
+        do {
+            zs.next_out = reinterpret_cast<Bytef*> (buffer.get ());
+            zs.avail_out = compressed_buffer_size;
+            result = deflate (&zs, flush);
+            if (result == Z_STREAM_ERROR)
+                throw std::runtime_error ("gzip compression failed");
+            write_fully (buffer.get (), compressed_buffer_size - zs.avail_out);
+        } while (zs.avail_out == 0
+                 || (flush == Z_FINISH && result != Z_STREAM_END));
+    } // GzipFile::deflate_all
+
+    void GzipFile::write (const char* data, std::size_t length)
+    {
+        zs.next_in = reinterpret_cast<Bytef*> (const_cast<char*> (data));
+        zs.avail_in = length;
+        deflate_all (Z_NO_FLUSH);
+        assert (zs.avail_in == 0);
+    } // GzipFile::write
+
+    void GzipFile::close ()
+    {
+        zs.next_in = Z_NULL;
+        zs.avail_in = 0;
+        deflate_all (Z_FINISH);
+        OutputFile::close ();
+    } // GzipFile::close
+
+#endif // HAVE_ZLIB
+
+#ifdef HAVE_ZSTD
+
+    // Writes a Zstandard frame with libzstd
+    class ZstdFile final : public OutputFile {
+
+    private:
+        std::unique_ptr<ZSTD_CStream, std::size_t (*) (ZSTD_CStream*)> zs;
+        std::unique_ptr<char[]> buffer;
+
+    public:
+        ZstdFile (const char* const filename, int level);
+
+        void write (const char* data, std::size_t length) override;
+        void close () override;
+    }; // class ZstdFile
+
+    ZstdFile::ZstdFile (const char* const filename, int level)
+        : OutputFile (filename), zs (ZSTD_createCStream (), ZSTD_freeCStream),
+          buffer (new char[compressed_buffer_size])
+    {
+        // The stream is freed by its holder if the constructor throws
+        if (level == Compression::default_level)
+            level = 3;
+        if (!zs || ZSTD_isError (ZSTD_initCStream (zs.get (), level)))
+            throw std::runtime_error ("Could not initialise zstd compression");
+    } // ZstdFile::ZstdFile
+
+    void ZstdFile::write (const char* data, std::size_t length)
+    {
+        ZSTD_inBuffer in = { data, length, 0 };
+        while (in.pos < in.size) {
+            ZSTD_outBuffer out = { buffer.get (), compressed_buffer_size, 0 };
+            std::size_t result = ZSTD_compressStream (zs.get (), &out, &in);
+            if (ZSTD_isError (result))
+                throw std::runtime_error (ZSTD_getErrorName (result));
+            write_fully (buffer.get (), out.pos);
+        } // while
+    } // ZstdFile::write
+
+    void ZstdFile::close ()
+    {
+        std::size_t remaining;
+        do {
+            ZSTD_outBuffer out = { buffer.get (), compressed_buffer_size, 0 };
+            remaining = ZSTD_endStream (zs.get (), &out);
+            if (ZSTD_isError (remaining))
+                throw std::runtime_error (ZSTD_getErrorName (remaining));
+            write_fully (buffer.get (), out.pos);
+        } while (remaining > 0);
+        OutputFile::close ();
+    } // ZstdFile::close
+
+#endif // HAVE_ZSTD
+
+    bool compression_supported (CompressionMethod method)
+    {
+        switch (method) {
+        case CompressionMethod::None:
+            return true;
+        case CompressionMethod::Gzip:
+#ifdef HAVE_ZLIB
+            return true;
+#else
+            return false;
+#endif // HAVE_ZLIB
+        case CompressionMethod::Zstd:
+#ifdef HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif // HAVE_ZSTD
+        } // switch
+        return false;
+    } // compression_supported
+
+    std::unique_ptr<OutputFile>
+    open_output_file (const char* const filename, const Compression& compression)
+    {
+        switch (compression.method) {
+#ifdef HAVE_ZLIB
+        case CompressionMethod::Gzip:
+            return std::unique_ptr<OutputFile>
+                (new GzipFile (filename, compression.level));
+#endif // HAVE_ZLIB
+#ifdef HAVE_ZSTD
+        case CompressionMethod::Zstd:
+            return std::unique_ptr<OutputFile>
+                (new ZstdFile (filename, compression.level));
+#endif // HAVE_ZSTD
+        case CompressionMethod::None:
+            return std::unique_ptr<OutputFile> (new OutputFile (filename));
+        default:
+            throw std::invalid_argument ("Compression method not supported");
+        } // switch
+    } // open_output_file
+
+} // namespace treecreeper
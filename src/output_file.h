@@ -0,0 +1,59 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#ifndef OUTPUT_FILE_H
+#define OUTPUT_FILE_H
+
+#include <climits>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace treecreeper {
+
+    enum class CompressionMethod {
+        None,
+        Gzip,
+        Zstd
+    };
+
+    struct Compression {
+        CompressionMethod method = CompressionMethod::None;
+        int level = default_level;
+
+        // Level used when none is given, which selects the library's
+        // default. Zero and negative levels are passed to the library.
+        static constexpr int default_level = INT_MIN;
+    };
+
+    // Destination file of an output stream. Blocks written to the file may
+    // be compressed on the fly, so that the uncompressed output never needs
+    // to exist as a whole.
+    class OutputFile {
+
+    private:
+        std::string filename;
+        int fd = -1;
+
+    protected:
+        // Write data to the file as it is
+        void write_fully (const char* data, std::size_t length);
+
+    public:
+        OutputFile (const char* const filename);
+        OutputFile (const OutputFile&) = delete;
+        virtual ~OutputFile ();
+
+        virtual void write (const char* data, std::size_t length);
+        virtual void close ();
+
+        const std::string& get_filename () const
+        { return filename; }
+    }; // class OutputFile
+
+    bool compression_supported (CompressionMethod method);
+    std::unique_ptr<OutputFile> open_output_file (const char* const filename,
+                                                  const Compression& compression);
+
+} // namespace treecreeper
+
+#endif // OUTPUT_FILE_H
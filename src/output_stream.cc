@@ -0,0 +1,69 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "cbor_stream.h"
+#include "json_stream.h"
+#include "output_stream.h"
+
+namespace treecreeper {
+
+    OutputStream::OutputStream (const char* const filename,
+                                const Compression& compression)
+        : file (open_output_file (filename, compression))
+    {
+        buffer = new char[buffer_size];
+    } // OutputStream::OutputStream
+
+    OutputStream::~OutputStream ()
+    {
+        delete[] buffer;
+    } // OutputStream::~OutputStream
+
+    void OutputStream::close ()
+    {
+        flush ();
+        file->close ();
+    } // OutputStream::close
+
+    void OutputStream::flush ()
+    {
+        file->write (buffer, buffer_used);
+        flushed += buffer_used;
+        buffer_used = 0;
+    } // OutputStream::flush
+
+    void OutputStream::put (const char* data, std::size_t length)
+    {
+        while (length > 0) {
+            if (buffer_used == buffer_size)
+                flush ();
+
+            std::size_t chunk = std::min (length, buffer_size - buffer_used);
+            std::memcpy (buffer + buffer_used, data, chunk);
+            buffer_used += chunk;
+            data += chunk;
+            length -= chunk;
+        } // while
+    } // OutputStream::put
+
+    std::unique_ptr<OutputStream>
+    open_output_stream (const char* const filename, OutputFormat format,
+                        const Compression& compression, bool records)
+    {
+        switch (format) {
+        case OutputFormat::CBOR:
+            return std::unique_ptr<OutputStream>
+                (new CBORStream (filename, compression, records));
+        case OutputFormat::JSON:
+        default:
+            return std::unique_ptr<OutputStream>
+                (new JSONStream (filename, compression, records));
+        } // switch
+    } // open_output_stream
+
+    const JSONRawString Null ("null");
+
+} // namespace treecreeper
@@ -0,0 +1,223 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#ifndef OUTPUT_STREAM_H
+#define OUTPUT_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "output_file.h"
+
+namespace treecreeper {
+
+    class JSONKey;
+    class JSONRawString;
+
+    enum class OutputFormat {
+        JSON,
+        CBOR
+    };
+
+    // Common interface of all output formats. The printers write a JSON-like
+    // tree of objects, arrays and scalar values, which the concrete streams
+    // encode and collect to a large buffer. The buffer is passed to the
+    // (possibly compressing) file only when it fills up or when the stream is
+    // closed.
+    class OutputStream {
+
+    private:
+        static const std::size_t buffer_size = 1 << 20;
+
+        std::unique_ptr<OutputFile> file;
+        char* buffer = nullptr;
+        std::size_t buffer_used = 0;
+        std::uint64_t flushed = 0;
+        std::uint64_t* block_offset = nullptr;
+
+        void flush ();
+
+    protected:
+        OutputStream (const char* const filename, const Compression& compression);
+
+        void put (const char* data, std::size_t length);
+
+        void put (char c)
+        {
+            if (buffer_used == buffer_size)
+                flush ();
+            buffer[buffer_used++] = c;
+        } // put
+
+        // Called by the streams right after the first byte of an object or
+        // an array is put, see mark_next_block
+        void block_opened ()
+        {
+            if (block_offset) {
+                *block_offset = offset () - 1;
+                block_offset = nullptr;
+            } // if
+        } // block_opened
+
+        virtual void write_null () = 0;
+        virtual void write_bool (bool value) = 0;
+        virtual void write_signed (long long value) = 0;
+        virtual void write_unsigned (unsigned long long value) = 0;
+        virtual void write_raw (const JSONRawString& value) = 0;
+        virtual void write_key (const char* name, std::size_t length) = 0;
+        virtual void write_key (const JSONKey& key) = 0;
+
+    public:
+        OutputStream (const OutputStream&) = delete;
+        virtual ~OutputStream ();
+        virtual void close ();
+
+        // Number of bytes written so far, before compression
+        std::uint64_t offset () const
+        { return flushed + buffer_used; }
+
+        // Store the offset of the next object or array to where. Unlike
+        // offset, this skips any separators written before the value.
+        void mark_next_block (std::uint64_t* where)
+        { block_offset = where; }
+
+        virtual OutputStream& write_string (const char* value, std::size_t length) = 0;
+        virtual OutputStream& new_object (bool compact = false) = 0;
+        virtual OutputStream& new_array (bool compact = false) = 0;
+        virtual OutputStream& end_array () = 0;
+        virtual OutputStream& end_object () = 0;
+
+        OutputStream& operator<< (const char* const value)
+        {
+            if (value)
+                return write_string (value, std::strlen (value));
+            write_null ();
+            return *this;
+        } // operator<<
+
+        OutputStream& operator<< (const unsigned char* const value)
+        { return *this << reinterpret_cast<const char*> (value); }
+
+        OutputStream& operator<< (const std::string& value)
+        { return write_string (value.data (), value.size ()); }
+
+        OutputStream& operator<< (bool value)
+        { write_bool (value); return *this; }
+
+        OutputStream& operator<< (const JSONRawString& value)
+        { write_raw (value); return *this; }
+
+        OutputStream& operator[] (const char* const name)
+        { write_key (name, std::strlen (name)); return *this; }
+
+        OutputStream& operator[] (const JSONKey& key)
+        { write_key (key); return *this; }
+
+        OutputStream& operator<< (int value)
+        { write_signed (value); return *this; }
+        OutputStream& operator<< (unsigned int value)
+        { write_unsigned (value); return *this; }
+
+        OutputStream& operator<< (long value)
+        { write_signed (value); return *this; }
+        OutputStream& operator<< (unsigned long value)
+        { write_unsigned (value); return *this; }
+
+        OutputStream& operator<< (long long value)
+        { write_signed (value); return *this; }
+        OutputStream& operator<< (unsigned long long value)
+        { write_unsigned (value); return *this; }
+    }; // class OutputStream
+
+    std::unique_ptr<OutputStream> open_output_stream (const char* const filename,
+                                                      OutputFormat format,
+                                                      const Compression& compression,
+                                                      bool records = false);
+
+    // A preformatted JSON token, such as null or an arbitrary precision
+    // integer.
+    class JSONRawString final {
+    private:
+        std::string str;
+
+    public:
+        JSONRawString (const std::string& value)
+            : str (value)
+            { }
+
+        JSONRawString (const char* const value)
+            : str (value)
+            { }
+
+        JSONRawString (const JSONRawString& value)
+            : str (value.str)
+            { }
+
+        const std::string& get_str_ref () const
+        { return str; }
+
+    }; // class JSONRawString
+
+    // Object field name, which is quoted at compile time. Keys are created
+    // with the _key literal suffix, e.g. stream["name"_key].
+    class JSONKey final {
+    private:
+        const char* const data;
+        const std::size_t length;
+
+    public:
+        constexpr JSONKey (const char* const data, const std::size_t length)
+            : data (data), length (length)
+            { }
+
+        // Quoted name followed by a colon
+        const char* quoted () const
+        { return data; }
+
+        std::size_t quoted_length () const
+        { return length; }
+
+        // Name without quotes
+        const char* name () const
+        { return data + 1; }
+
+        std::size_t name_length () const
+        { return length - 3; }
+    }; // class JSONKey
+
+    template <char... Chars> struct JSONQuotedKey {
+        static constexpr char data[] = { '"', Chars..., '"', ':' };
+    }; // struct JSONQuotedKey
+
+    template <char... Chars>
+        constexpr char JSONQuotedKey<Chars...>::data[];
+
+    constexpr bool is_plain_key (const char* chars, std::size_t length)
+    {
+        for (std::size_t j = 0; j < length; j++) {
+            if (static_cast<unsigned char> (chars[j]) < 0x20
+                || chars[j] == '"' || chars[j] == '\\')
+                return false;
+        } // for
+        return true;
+    } // is_plain_key
+
+    template <typename Char, Char... Chars> constexpr JSONKey
+        operator"" _key ()
+    {
+        static_assert (std::is_same<Char, char>::value,
+                       "Keys must be narrow string literals");
+        static_assert (is_plain_key (JSONQuotedKey<Chars...>::data + 1,
+                                     sizeof... (Chars)),
+                       "Keys must not need escaping");
+        return JSONKey (JSONQuotedKey<Chars...>::data, sizeof... (Chars) + 3);
+    } // operator"" _key
+
+    extern const JSONRawString Null;
+
+} // namespace treecreeper
+
+#endif // OUTPUT_STREAM_H
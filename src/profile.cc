@@ -0,0 +1,56 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#include <chrono>
+
+#include "profile.h"
+
+namespace treecreeper {
+
+    ProfileScope* ProfileScope::current = nullptr;
+
+    void ProfileScope::begin (ProfileCounter& counter, const OutputStream* stream)
+    {
+        this->counter = &counter;
+        this->stream = stream;
+        if (stream)
+            start_offset = stream->offset ();
+        parent = current;
+        current = this;
+        counter.calls++;
+        start = clock::now ();
+    } // ProfileScope::begin
+
+    void ProfileScope::end ()
+    {
+        double seconds = std::chrono::duration<double> (clock::now () - start).count ();
+        std::uint64_t bytes = stream ? stream->offset () - start_offset : 0;
+
+        counter->seconds += seconds;
+        counter->self_seconds += seconds - nested_seconds;
+        counter->bytes += bytes;
+        counter->self_bytes += bytes - nested_bytes;
+
+        // Bytes written to other streams are not part of the enclosing scope
+        current = parent;
+        if (parent) {
+            parent->nested_seconds += seconds;
+            if (stream == parent->stream)
+                parent->nested_bytes += bytes;
+        } // if
+    } // ProfileScope::end
+
+    void
+    print_profile_counter (OutputStream& stream, const ProfileCounter& counter)
+    {
+        // Times are written in microseconds to keep them integers
+        stream["calls"_key] << counter.calls;
+        stream["references"_key] << counter.references;
+        stream["bytes"_key] << counter.bytes;
+        stream["self bytes"_key] << counter.self_bytes;
+        stream["microseconds"_key]
+            << static_cast<std::uint64_t> (counter.seconds * 1e6);
+        stream["self microseconds"_key]
+            << static_cast<std::uint64_t> (counter.self_seconds * 1e6);
+    } // print_profile_counter
+
+} // namespace treecreeper
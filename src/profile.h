@@ -0,0 +1,73 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <chrono>
+#include <cstdint>
+
+#include "output_stream.h"
+#include "traverse.h"
+
+namespace treecreeper {
+
+    // True if the printers should be profiled. Like verbose, this is checked
+    // before anything is counted or timed, so that profiling costs a single
+    // comparison when it is disabled.
+    inline bool profiling ()
+    { return !options.stats_file.empty (); }
+
+    // Cumulative cost of a printer, a phase or a function. Total values
+    // include everything measured within it, self values exclude the nested
+    // measurements.
+    struct ProfileCounter {
+        std::uint64_t calls = 0;
+        std::uint64_t references = 0;   // Calls which wrote only a reference
+        std::uint64_t bytes = 0;
+        std::uint64_t self_bytes = 0;
+        double seconds = 0;
+        double self_seconds = 0;
+    }; // struct ProfileCounter
+
+    // Measures the lifetime of the scope into a counter and counts it as a
+    // call. Bytes are counted only if a stream is given.
+    class ProfileScope {
+
+    private:
+        typedef std::chrono::steady_clock clock;
+
+        static ProfileScope* current;
+
+        ProfileCounter* counter = nullptr;
+        const OutputStream* stream = nullptr;
+        ProfileScope* parent = nullptr;
+        clock::time_point start;
+        std::uint64_t start_offset = 0;
+        std::uint64_t nested_bytes = 0;
+        double nested_seconds = 0;
+
+        void begin (ProfileCounter& counter, const OutputStream* stream);
+        void end ();
+
+    public:
+        ProfileScope (ProfileCounter& counter, const OutputStream* stream = nullptr)
+        {
+            if (profiling ())
+                begin (counter, stream);
+        } // ProfileScope
+
+        ProfileScope (const ProfileScope&) = delete;
+
+        ~ProfileScope ()
+        {
+            if (counter)
+                end ();
+        } // ~ProfileScope
+    }; // class ProfileScope
+
+    // Write the counter as the fields of an object
+    void print_profile_counter (OutputStream& stream, const ProfileCounter& counter);
+
+} // namespace treecreeper
+
+#endif // PROFILE_H
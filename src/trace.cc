@@ -0,0 +1,38 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#include <ext/stdio_filebuf.h>
+#include <ostream>
+
+#include <unistd.h>
+
+#include "trace.h"
+
+namespace treecreeper {
+
+    // Size of the trace buffer
+    static const std::size_t trace_buffer_size = 1 << 16;
+
+    static std::ostream* trace_stream = nullptr;
+
+    std::ostream&
+    trace ()
+    {
+        // Created on first use, so silent runs do not allocate the buffer.
+        // The buffer closes its descriptor, so give it a copy of stderr.
+        if (!trace_stream) {
+            static __gnu_cxx::stdio_filebuf<char> buffer (::dup (STDERR_FILENO),
+                                                          std::ios::out,
+                                                          trace_buffer_size);
+            trace_stream = new std::ostream (&buffer);
+        } // if
+        return *trace_stream;
+    } // trace
+
+    void
+    flush_trace ()
+    {
+        if (trace_stream)
+            trace_stream->flush ();
+    } // flush_trace
+
+} // namespace treecreeper
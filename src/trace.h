@@ -0,0 +1,33 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <ostream>
+
+#include "traverse.h"
+
+namespace treecreeper {
+
+    // Verbosity levels of trace messages
+    enum Verbosity {
+        VERBOSE_SILENT = 0,
+        VERBOSE_PHASES = 1,     // Compilation and output phases
+        VERBOSE_NODES = 2,      // Each visited node, briefly
+        VERBOSE_DETAILS = 3     // Each visited node with description and context
+    };
+
+    // True if messages of the given level should be written. Callers check
+    // this before formatting anything, so that tracing costs a single
+    // comparison when it is disabled.
+    inline bool verbose (int level)
+    { return options.verbose >= level; }
+
+    // Stream for trace messages. It writes to standard error through a large
+    // buffer, which is flushed when it fills up and by flush_trace.
+    std::ostream& trace ();
+    void flush_trace ();
+
+} // namespace treecreeper
+
+#endif // TRACE_H
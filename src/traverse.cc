@@ -1,19 +1,31 @@
 // -*- mode: c++; c-basic-offset: 4 -*-
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <set>
 #include <sstream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
+#include <fnmatch.h>
 #include <gmp.h>
 
 #include "interface.h"
-#include "json_stream.h"
+#include "locations.h"
+#include "node_table.h"
+#include "output_stream.h"
+#include "profile.h"
+#include "trace.h"
 #include "traverse.h"
 
 #include "gcc-plugin.h"
@@ -33,196 +45,444 @@
 #include "tree-pretty-print.h"
 #include "wide-int.h"
 #include "stringpool.h" //For get_identifier
+#include "timevar.h"
 
 namespace treecreeper {
 
-    typedef void(*tree_printer_func)(JSONStream&, const_tree);
+    typedef void(*tree_printer_func)(OutputStream&, const_tree);
 
-    // Mapping from tree nodes to unique numeric IDs.
-    std::unordered_map<const_tree, int> tree_id_map;
+    // Ids and visited state of all seen tree nodes. Nodes which are seen
+    // but not printed in full are printed at the end of the root. This is
+    // necessary, because C frontend only makes some tree nodes accessible
+    // through per-node callbacks, whereas in C++ everything is reachable from
+    // within the global namespace node.
+    NodeTable nodes;
 
-    // Compare ..._DECL nodes by their source location. When node is not a declaration, order by pointer.
+    // Compare ..._DECL nodes by their source location. Declarations come
+    // before other nodes, and ties are broken by tree code and uid, so that
+    // the order does not change from run to run. Only nodes without a uid
+    // are ordered by pointer.
     class DeclLocationComparator {
+    private:
+        static unsigned int uid (const_tree node)
+        {
+            if (DECL_P (node))
+                return DECL_UID (node);
+            else if (TYPE_P (node))
+                return TYPE_UID (node);
+            return 0;
+        } // uid
+
     public:
         bool operator() (const_tree a, const_tree b) const
         {
-            if (TREE_CODE_CLASS (TREE_CODE (a)) == tcc_declaration
-                && TREE_CODE_CLASS (TREE_CODE (b)) == tcc_declaration)
+            const bool a_is_decl = DECL_P (a);
+            if (a_is_decl != DECL_P (b))
+                return a_is_decl;
+            if (a_is_decl && DECL_SOURCE_LOCATION (a) != DECL_SOURCE_LOCATION (b))
                 return DECL_SOURCE_LOCATION (a) < DECL_SOURCE_LOCATION (b);
-            else
-                return a < b;
+            if (TREE_CODE (a) != TREE_CODE (b))
+                return TREE_CODE (a) < TREE_CODE (b);
+            if (uid (a) != uid (b))
+                return uid (a) < uid (b);
+            return a < b;
         } // operator()
     }; // class DeclLocationComparator
 
-    // Set of nodes ordered by their source location or pointer value.
+    // Set of nodes ordered by their source location.
     typedef std::set<const_tree, DeclLocationComparator> node_set;
 
-    // Sets for storing all visited and seen tree nodes. This is necessary,
-    // because C frontend only makes some tree nodes accessible through
-    // per-node callbacks, whereas in C++ everything is reachable from within
-    // the global namespace node.
-    std::unordered_set<const_tree> visited_nodes;
-    node_set all_nodes;
-
     // Map for collecting all CONST_DECLnodes. This is useful to unify
     // differences between C and C++ frotnends' enumeration type handling. See
     // print_enumeral_type for details.
     typedef std::multimap<const_tree, const_tree> const_decl_map;
     const_decl_map const_decl_nodes;
 
-    static void call_printer (JSONStream& stream, tree_printer_func func, const_tree node);
+    // Source files of the unit in the order of the file table, and their
+    // indices by the name pointers of line maps and by name. See
+    // intern_file.
+    std::vector<std::pair<const char*, bool>> files;
+    std::unordered_map<const char*, unsigned int> file_indices;
+    std::unordered_map<std::string, unsigned int> file_indices_by_name;
+
+    // Interned identifier names in the order of the string table, and their
+    // indices by name pointer. Tree identifiers and preprocessor hash nodes
+    // share the same strings, so macro names are interned with them.
+    std::vector<const char*> strings;
+    std::unordered_map<const char*, unsigned int> string_indices;
+
+    // Cache of type descriptions, see describe.
+    std::unordered_map<const_tree, std::string> type_descriptions;
+
+    // Stable ids by sequential id, and the set of stable ids given so far.
+    // See make_stable_id.
+    std::vector<std::uint64_t> stable_ids;
+    std::unordered_set<std::uint64_t> used_stable_ids;
+
+    // Results of the namespace filters for a namespace and its members
+    struct NamespaceFilter {
+        bool included;      // Members are kept, unless excluded
+        bool excluded;      // Members are dropped
+        bool traversed;     // Included namespaces may be nested inside
+    }; // struct NamespaceFilter
+
+    // Results of the file filters by file name pointer, and of the
+    // namespace filters by namespace (null for the global scope). See
+    // is_filtered.
+    std::unordered_map<const char*, bool> file_filters;
+    std::unordered_map<const_tree, NamespaceFilter> namespace_filters;
+
+    // Nodes which have an id but are not yet printed in the flat layout
+    std::deque<const_tree> flat_queue;
+
+    // Output of the records mode, see open_records.
+    std::unique_ptr<OutputStream> record_stream;
+
+    // Side index of the output, see open_index.
+    std::unique_ptr<OutputStream> index_stream;
+
+    // Top level parts of the output, which are profiled as phases
+    enum Phase {
+        PHASE_METADATA,
+        PHASE_FILES,
+        PHASE_DECLARATIONS,
+        PHASE_RECORDS,
+        PHASE_MACROS,
+        PHASE_INCLUDES,
+        PHASE_STRINGS,
+        PHASE_COUNT
+    };
+
+    static const char* const phase_names[PHASE_COUNT] = {
+        "metadata", "files", "declarations", "records", "macros", "includes",
+        "strings"
+    };
+
+    // Profiles of the printers by tree code, of the phases and of the
+    // helpers shared by many printers. See print_stats.
+    ProfileCounter printer_profiles[MAX_TREE_CODES];
+    ProfileCounter phase_profiles[PHASE_COUNT];
+    ProfileCounter describe_profile;
+    ProfileCounter macro_profile;
+    ProfileCounter line_map_profile;
+
+    static void build_file_table ();
+    static void call_printer (OutputStream& stream, tree_printer_func func, const_tree node);
+    static void close_index ();
+    static void collect_namespace_roots (const_tree ns, node_set& roots);
+    static void collect_roots (std::vector<const_tree>& roots);
+    static void collect_unvisited_nodes (std::vector<const_tree>& pending);
+    static void count_reference (const_tree node);
+    static void describe (const_tree node, const char*& text, size_t& length);
+    static const NamespaceFilter& filter_namespace (const_tree ns);
     static const_tree find_const_decl (const_tree type, const_tree node);
+    static std::uint64_t flat_id (const_tree node);
+    static void format_description (const_tree node, const char*& text, size_t& length);
     static JSONRawString get_int_value (const_tree cst);
+    static unsigned int get_tree_id (const_tree node);
     static const char* get_tree_name_ptr (const_tree node);
+    static std::uint64_t hash_mix (std::uint64_t seed, std::uint64_t value);
+    static std::uint64_t hash_node (const_tree node);
+    static std::uint64_t hash_string (std::uint64_t seed, const char* str);
+    static std::uint64_t hash_type (std::uint64_t seed, const_tree type, int depth);
+    static unsigned int intern_file (const char* name, bool system_header);
+    static bool is_anonymous (const_tree type);
+    static bool is_file_scope (const_tree node);
+    static bool is_file_wanted (const char* file, bool system_header);
+    static bool is_filtered (const_tree node);
+    static bool is_incomplete (const_tree node);
+    static bool is_root (const_tree node);
     static std::string make_description (const_tree node);
+    static std::uint64_t make_stable_id (const_tree node);
+    static bool matches_any (const std::vector<std::string>& patterns, const char* str);
     static int make_tree_id (const_tree node);
-    static void print_all_line_maps (JSONStream& stream);
-    static void print_all_macros (JSONStream& stream);
-    static void print_all_translation_units (JSONStream& stream);
-    static void print_array_type (JSONStream& stream, const_tree type);
-    static void print_block (JSONStream& stream, const_tree block);
-    static void print_block_list (JSONStream& stream, const_tree block);
-    static void print_common_constant (JSONStream& stream, const_tree cst);
-    static void print_common_declaration (JSONStream& stream, const_tree decl);
-    static void print_common_description (JSONStream& stream, const_tree node);
-    static void print_common_precision (JSONStream& stream, const_tree type);
-    static void print_common_tree (JSONStream& stream, const_tree node, bool supported = true);
-    static void print_common_type (JSONStream& stream, const_tree type);
-    static void print_common_visibility (JSONStream& stream, const_tree decl);
-    static void print_complex_constant (JSONStream& stream, const_tree cst);
-    static void print_complex_type (JSONStream& stream, const_tree type);
-    static void print_const_decl (JSONStream& stream, const_tree decl);
-    static void print_enumeral_type (JSONStream& stream, const_tree type);
-    static void print_field_decl (JSONStream& stream, const_tree decl);
-    static void print_fixed_point_constant (JSONStream& stream, const_tree cst);
-    static void print_fixed_point_type (JSONStream& stream, const_tree type);
-    static void print_function_decl (JSONStream& stream, const_tree decl);
-    static void print_function_type (JSONStream& stream, const_tree type);
-    static void print_identifier (JSONStream& stream, const_tree id);
-    static void print_integer_constant (JSONStream& stream, const_tree cst);
-    static void print_integer_type (JSONStream& stream, const_tree type);
-    static void print_line_map (JSONStream& stream, line_map_ordinary* map);
-    static void print_line_map_location (JSONStream& stream, line_map_ordinary* map);
-    static void print_location (JSONStream& stream, source_location loc);
+    static void open_index ();
+    static std::uint64_t output_id (unsigned int id);
+    static void print_all_line_maps (OutputStream& stream);
+    static void print_all_macros (OutputStream& stream);
+    static void print_all_translation_units (OutputStream& stream);
+    static void print_array_type (OutputStream& stream, const_tree type);
+    static void print_block (OutputStream& stream, const_tree block);
+    static void print_block_list (OutputStream& stream, const_tree block);
+    static void print_common_constant (OutputStream& stream, const_tree cst);
+    static void print_common_declaration (OutputStream& stream, const_tree decl);
+    static void print_common_description (OutputStream& stream, const_tree node);
+    static void print_common_precision (OutputStream& stream, const_tree type);
+    static void print_common_tree (OutputStream& stream, const_tree node, bool supported = true);
+    static void print_common_type (OutputStream& stream, const_tree type);
+    static void print_common_visibility (OutputStream& stream, const_tree decl);
+    static void print_complex_constant (OutputStream& stream, const_tree cst);
+    static void print_complex_type (OutputStream& stream, const_tree type);
+    static void print_const_decl (OutputStream& stream, const_tree decl);
+    static void print_enumeral_type (OutputStream& stream, const_tree type);
+    static void print_field_decl (OutputStream& stream, const_tree decl);
+    static void print_file_table (OutputStream& stream);
+    static void print_flat_layout (OutputStream& stream);
+    static void print_fixed_point_constant (OutputStream& stream, const_tree cst);
+    static void print_fixed_point_type (OutputStream& stream, const_tree type);
+    static void print_function_decl (OutputStream& stream, const_tree decl);
+    static void print_function_type (OutputStream& stream, const_tree type);
+    static void print_identifier (OutputStream& stream, const_tree id);
+    static void print_index_entry (const_tree node, std::uint64_t offset, std::uint64_t length);
+    static void print_integer_constant (OutputStream& stream, const_tree cst);
+    static void print_integer_type (OutputStream& stream, const_tree type);
+    static void print_line_map (OutputStream& stream, line_map_ordinary* map,
+                                std::vector<bool>& kept);
+    static void print_line_map_location (OutputStream& stream, line_map_ordinary* map);
+    static void print_location (OutputStream& stream, source_location loc);
     static int print_macro (cpp_reader*, cpp_hashnode* node, void* stream_ptr);
-    static void print_metadata (JSONStream& stream, plugin_gcc_version* version);
-    static void print_namespace (JSONStream& stream, const_tree ns);
-    static void print_pointer_type (JSONStream& stream, const_tree type);
-    static void print_precisioned_type (JSONStream& stream, const_tree type);
-    static void print_real_constant (JSONStream& stream, const_tree cst);
-    static void print_record_type (JSONStream& stream, const_tree type);
-    static void print_reference  (JSONStream& stream, const_tree node);
-    static void print_root (JSONStream& stream, plugin_gcc_version* version);
-    static void print_simple_type (JSONStream& stream, const_tree type);
-    static void print_string_constant (JSONStream& stream, const_tree cst);
-    static void print_unsupported_node (JSONStream& stream, const_tree node);
-    static void print_template_decl (JSONStream& stream, const_tree decl);
-    static void print_translation_unit_decl (JSONStream& stream, const_tree decl);
-    static void print_type_decl (JSONStream& stream, const_tree decl);
-    static void print_var_decl (JSONStream& stream, const_tree decl);
-    static void print_vector_constant (JSONStream& stream, const_tree cst);
-    static void print_vector_type (JSONStream& stream, const_tree type);
+    static void print_metadata (OutputStream& stream, plugin_gcc_version* version);
+    static void print_name (OutputStream& stream, const char* name);
+    static void print_namespace (OutputStream& stream, const_tree ns);
+    static void print_node (OutputStream& stream, tree_printer_func func, const_tree node);
+    static void print_pointer_type (OutputStream& stream, const_tree type);
+    static void print_precisioned_type (OutputStream& stream, const_tree type);
+    static void print_real_constant (OutputStream& stream, const_tree cst);
+    static void print_record (const_tree node);
+    static void print_record_type (OutputStream& stream, const_tree type);
+    static void print_reference  (OutputStream& stream, int id);
+    static void print_root (OutputStream& stream, plugin_gcc_version* version);
+    static void print_simple_type (OutputStream& stream, const_tree type);
+    static void print_stats ();
+    static void print_string_constant (OutputStream& stream, const_tree cst);
+    static void print_string_table (OutputStream& stream);
+    static void print_unsupported_node (OutputStream& stream, const_tree node);
+    static void print_unvisited_nodes (OutputStream& stream);
+    static void print_template_decl (OutputStream& stream, const_tree decl);
+    static void print_trailer (OutputStream& stream);
+    static void print_translation_unit_decl (OutputStream& stream, const_tree decl);
+    static void print_type_decl (OutputStream& stream, const_tree decl);
+    static void print_var_decl (OutputStream& stream, const_tree decl);
+    static void print_vector_constant (OutputStream& stream, const_tree cst);
+    static void print_vector_type (OutputStream& stream, const_tree type);
+    static std::string qualified_name (const_tree node);
+    static void remember_const_decl (const_tree node);
+    static void remember_namespace_members (const_tree ns);
     static void remember_node (const_tree node);
-    static bool should_only_reference (const_tree node);
+    static bool want (unsigned int field);
 
-    static JSONStream& operator<< (JSONStream& stream, const_tree node);
-    static JSONStream& operator<< (JSONStream& stream, signop op);
+    static OutputStream& operator<< (OutputStream& stream, const_tree node);
+    static OutputStream& operator<< (OutputStream& stream, signop op);
     static std::ostream& operator<< (std::ostream& stream, const_tree node);
 
     OPTIONS options;
 
-    const std::unordered_map<int, const tree_printer_func> tree_printer_map = {
+    // Names of field groups for the fields plugin argument
+    static const std::pair<const char*, unsigned int> field_names[] = {
+        { "name", FIELD_NAME },
+        { "description", FIELD_DESCRIPTION },
+        { "location", FIELD_LOCATION },
+        { "context", FIELD_CONTEXT },
+        { "type", FIELD_TYPE },
+        { "fields", FIELD_FIELDS },
+        { "arguments", FIELD_ARGUMENTS },
+        { "values", FIELD_VALUES },
+        { "size", FIELD_SIZE },
+        { "qualifiers", FIELD_QUALIFIERS },
+        { "access", FIELD_ACCESS },
+        { "visibility", FIELD_VISIBILITY },
+        { "attributes", FIELD_ATTRIBUTES },
+        { "language", FIELD_LANGUAGE },
+        { "flags", FIELD_FLAGS },
+        { "tokens", FIELD_TOKENS },
+        { "macros", FIELD_MACROS },
+        { "includes", FIELD_INCLUDES },
+        { "all", FIELD_ALL }
+    }; // field_names
+
+    // Printer functions indexed by tree code
+    struct TreePrinterTable {
+        tree_printer_func printers[MAX_TREE_CODES];
+    }; // struct TreePrinterTable
+
+    static constexpr TreePrinterTable
+    make_tree_printer_table ()
+    {
+        TreePrinterTable table {};
+        for (int code = 0; code < MAX_TREE_CODES; code++)
+            table.printers[code] = print_unsupported_node;
+
         // Declarations
-        { CONST_DECL, print_const_decl },
-        { FIELD_DECL, print_field_decl },
-        { FUNCTION_DECL, print_function_decl },
-        { NAMESPACE_DECL, print_namespace },
-        { TRANSLATION_UNIT_DECL, print_translation_unit_decl },
-        { TYPE_DECL, print_type_decl },
-        { PARM_DECL, print_var_decl },
-        { RESULT_DECL, print_var_decl },
-        { TEMPLATE_DECL, print_template_decl },
-        { VAR_DECL, print_var_decl },
+        table.printers[CONST_DECL] = print_const_decl;
+        table.printers[FIELD_DECL] = print_field_decl;
+        table.printers[FUNCTION_DECL] = print_function_decl;
+        table.printers[NAMESPACE_DECL] = print_namespace;
+        table.printers[TRANSLATION_UNIT_DECL] = print_translation_unit_decl;
+        table.printers[TYPE_DECL] = print_type_decl;
+        table.printers[PARM_DECL] = print_var_decl;
+        table.printers[RESULT_DECL] = print_var_decl;
+        table.printers[TEMPLATE_DECL] = print_template_decl;
+        table.printers[VAR_DECL] = print_var_decl;
 
         // Types
-        { ARRAY_TYPE, print_array_type },
-        { BOOLEAN_TYPE, print_simple_type },
-        { LANG_TYPE, print_simple_type },
-        { VOID_TYPE, print_simple_type },
-        { COMPLEX_TYPE, print_complex_type },
-        { ENUMERAL_TYPE, print_enumeral_type },
-        { FIXED_POINT_TYPE, print_fixed_point_type },
-        { FUNCTION_TYPE, print_function_type },
-        { METHOD_TYPE, print_function_type },
-        { INTEGER_TYPE, print_integer_type },
-        { NULLPTR_TYPE, print_pointer_type },
-        { POINTER_TYPE, print_pointer_type },
-        { POINTER_BOUNDS_TYPE, print_precisioned_type },
-        { REFERENCE_TYPE, print_pointer_type },
-        { REAL_TYPE, print_precisioned_type },
-        { RECORD_TYPE, print_record_type },
-        { QUAL_UNION_TYPE, print_record_type },
-        { UNION_TYPE, print_record_type },
-        { VECTOR_TYPE, print_vector_type },
+        table.printers[ARRAY_TYPE] = print_array_type;
+        table.printers[BOOLEAN_TYPE] = print_simple_type;
+        table.printers[LANG_TYPE] = print_simple_type;
+        table.printers[VOID_TYPE] = print_simple_type;
+        table.printers[COMPLEX_TYPE] = print_complex_type;
+        table.printers[ENUMERAL_TYPE] = print_enumeral_type;
+        table.printers[FIXED_POINT_TYPE] = print_fixed_point_type;
+        table.printers[FUNCTION_TYPE] = print_function_type;
+        table.printers[METHOD_TYPE] = print_function_type;
+        table.printers[INTEGER_TYPE] = print_integer_type;
+        table.printers[NULLPTR_TYPE] = print_pointer_type;
+        table.printers[POINTER_TYPE] = print_pointer_type;
+        table.printers[POINTER_BOUNDS_TYPE] = print_precisioned_type;
+        table.printers[REFERENCE_TYPE] = print_pointer_type;
+        table.printers[REAL_TYPE] = print_precisioned_type;
+        table.printers[RECORD_TYPE] = print_record_type;
+        table.printers[QUAL_UNION_TYPE] = print_record_type;
+        table.printers[UNION_TYPE] = print_record_type;
+        table.printers[VECTOR_TYPE] = print_vector_type;
         // Constants
-        { COMPLEX_CST, print_complex_constant },
-        { INTEGER_CST, print_integer_constant },
-        { FIXED_CST, print_fixed_point_constant },
-        { REAL_CST, print_real_constant },
-        { STRING_CST, print_string_constant },
-        { VECTOR_CST, print_vector_constant },
+        table.printers[COMPLEX_CST] = print_complex_constant;
+        table.printers[INTEGER_CST] = print_integer_constant;
+        table.printers[FIXED_CST] = print_fixed_point_constant;
+        table.printers[REAL_CST] = print_real_constant;
+        table.printers[STRING_CST] = print_string_constant;
+        table.printers[VECTOR_CST] = print_vector_constant;
         // Exceptional nodes
-        { BLOCK, print_block_list },
-        { IDENTIFIER_NODE, print_identifier }
-    }; // tree_printer_map
+        table.printers[BLOCK] = print_block_list;
+        table.printers[IDENTIFIER_NODE] = print_identifier;
+        return table;
+    } // make_tree_printer_table
+
+    static constexpr TreePrinterTable tree_printers = make_tree_printer_table ();
 
-    static JSONStream& operator<< (JSONStream& stream, const_tree node)
+    static OutputStream& operator<< (OutputStream& stream, const_tree node)
     {
         if (!node)
             return stream << Null;
 
-        try {
-            const auto& function = tree_printer_map.at (TREE_CODE (node));
-            call_printer (stream, function, node);
-        } catch (std::out_of_range& e) {
-            std::cerr << "treecreeper: Unsupported tree node " << node
-                      << ". Output will be incomplete.\n";
-            print_unsupported_node (stream, node);
-        } // try...catch
+        call_printer (stream, tree_printers.printers[TREE_CODE (node)], node);
         return stream;
     } // operator<<
 
-    static bool
-    should_only_reference (const_tree node)
+    static void
+    build_file_table ()
     {
-        int code = TREE_CODE (node);
-        if (code == IDENTIFIER_NODE)
-            return false;
+        // Every source file has at least one ordinary line map
+        for (unsigned int j = 0; j < LINEMAPS_ORDINARY_USED (line_table); j++) {
+            line_map_ordinary* map = LINEMAPS_ORDINARY_MAP_AT (line_table, j);
+            const char* name = ORDINARY_MAP_FILE_NAME (map);
+            if (name)
+                intern_file (name, ORDINARY_MAP_IN_SYSTEM_HEADER_P (map));
+        } // for
+    } // build_file_table
 
-        if (visited_nodes.count (node))
-            return true;
+    static void
+    call_printer (OutputStream& stream, tree_printer_func func, const_tree node)
+    {
+        // In the flat layout edges are ids, except for plain identifiers.
+        // Block lists are arrays of ids, see print_block_list.
+        if (options.layout == Layout::Flat) {
+            if ((TREE_CODE (node) == IDENTIFIER_NODE && !IDENTIFIER_TYPENAME_P (node))
+                || (TREE_CODE (node) == BLOCK && func == print_block_list))
+                print_node (stream, func, node);
+            else {
+                count_reference (node);
+                stream << flat_id (node);
+            } // if
+            return;
+        } // if
 
-        return false;
-    } // should_only_reference
+        auto& entry = nodes.get (node);
+        if (!entry.id)
+            entry.id = make_tree_id (node);
+        if (options.records && !entry.visited)
+            entry.incomplete = is_incomplete (node);
+
+        // Identifiers are always printed in full
+        if (entry.visited && TREE_CODE (node) != IDENTIFIER_NODE) {
+            count_reference (node);
+            print_reference (stream, entry.id);
+        } else {
+            // The entry may move while the node is printed
+            entry.visited = true;
+            print_node (stream, func, node);
+        } // if
+    } // call_printer
 
     static void
-    call_printer (JSONStream& stream, tree_printer_func func, const_tree node)
+    close_index ()
     {
-        if (!tree_id_map.count (node)) {
-            tree_id_map[node] = make_tree_id (node);
-            all_nodes.insert (node);
+        if (index_stream) {
+            index_stream->close ();
+            index_stream.reset ();
         } // if
+    } // close_index
 
-        if (should_only_reference (node))
-            print_reference (stream, node);
-        else {
-            visited_nodes.insert (node);
-            func (stream, node);
+    static void
+    collect_namespace_roots (const_tree ns, node_set& roots)
+    {
+        cp_binding_level* level = NAMESPACE_LEVEL (ns);
+        for (const_tree decl = level->names; decl; decl = TREE_CHAIN (decl)) {
+            // Enumeration types may be reached from the roots, see
+            // print_enumeral_type
+            remember_const_decl (decl);
+            if (is_root (decl))
+                roots.insert (decl);
+        } // for
+
+        for (auto decl = level->namespaces; decl; decl = TREE_CHAIN (decl)) {
+            if (!DECL_NAMESPACE_ALIAS (decl) && !is_filtered (decl))
+                collect_namespace_roots (decl, roots);
+        } // for
+    } // collect_namespace_roots
+
+    static void
+    collect_roots (std::vector<const_tree>& roots)
+    {
+        // Declarations matching the roots argument in source order. The C
+        // frontend has no global namespace, so look at the remembered nodes
+        // too.
+        node_set found;
+        if (global_namespace)
+            collect_namespace_roots (global_namespace, found);
+        nodes.for_each ([&found] (const NodeEntry& entry) {
+                const_tree node = static_cast<const_tree> (entry.node);
+                if (is_file_scope (node) && is_root (node))
+                    found.insert (node);
+            });
+        roots.assign (found.begin (), found.end ());
+    } // collect_roots
+
+    static void
+    collect_unvisited_nodes (std::vector<const_tree>& pending)
+    {
+        // Remembered nodes, which were not reached from the roots, in order
+        // of their source location
+        std::vector<std::pair<unsigned int, const_tree>> unvisited;
+        nodes.for_each ([&unvisited] (const NodeEntry& entry) {
+                if (!entry.visited)
+                    unvisited.emplace_back (entry.location,
+                                            static_cast<const_tree> (entry.node));
+            });
+        std::sort (unvisited.begin (), unvisited.end (),
+                   [] (const std::pair<unsigned int, const_tree>& a,
+                       const std::pair<unsigned int, const_tree>& b) {
+                       if (a.first != b.first)
+                           return a.first < b.first;
+                       return DeclLocationComparator () (a.second, b.second);
+                   });
+
+        pending.clear ();
+        for (auto& elem : unvisited)
+            pending.push_back (elem.second);
+    } // collect_unvisited_nodes
+
+    static void
+    count_reference (const_tree node)
+    {
+        if (profiling ()) {
+            auto& profile = printer_profiles[TREE_CODE (node)];
+            profile.calls++;
+            profile.references++;
         } // if
-    } // accept
+    } // count_reference
 
-    static JSONStream&
-    operator<< (JSONStream& stream, signop op)
+    static OutputStream&
+    operator<< (OutputStream& stream, signop op)
     {
         switch (op) {
         case SIGNED:
@@ -236,6 +496,50 @@ namespace treecreeper {
         return stream;
     } // operator<<
 
+    static const NamespaceFilter&
+    filter_namespace (const_tree ns)
+    {
+        if (ns == global_namespace || (ns && TREE_CODE (ns) != NAMESPACE_DECL))
+            ns = nullptr;
+        auto cached = namespace_filters.find (ns);
+        if (cached != namespace_filters.end ())
+            return cached->second;
+
+        // The global scope matches only the pattern ::, and nested
+        // namespaces inherit the results of the enclosing ones
+        NamespaceFilter filter;
+        std::string name;
+        if (!ns) {
+            name = "::";
+            filter.included = options.include_namespaces.empty ();
+            filter.excluded = false;
+        } else {
+            name = qualified_name (ns);
+            const NamespaceFilter& parent = filter_namespace (DECL_CONTEXT (ns));
+            filter.included = parent.included;
+            filter.excluded = parent.excluded;
+        } // if
+
+        filter.included = filter.included
+            || matches_any (options.include_namespaces, name.c_str ());
+        filter.excluded = filter.excluded
+            || matches_any (options.exclude_namespaces, name.c_str ());
+
+        // Look inside namespaces which may hold an included one
+        filter.traversed = filter.included;
+        if (ns) {
+            name += "::";
+            for (auto& pattern : options.include_namespaces) {
+                if (!pattern.compare (0, name.size (), name)
+                    || pattern.find_first_of ("*?[") != std::string::npos)
+                    filter.traversed = true;
+            } // for
+        } // if
+        filter.traversed = filter.traversed && !filter.excluded;
+
+        return namespace_filters.emplace (ns, filter).first->second;
+    } // filter_namespace
+
     static const_tree
     find_const_decl (const_tree type, const_tree node)
     {
@@ -260,6 +564,33 @@ namespace treecreeper {
         throw std::logic_error (err.str ());
     } // find_const_decl
 
+    static std::uint64_t
+    flat_id (const_tree node)
+    {
+        // Ids are given in the order of the queue, so the nodes array of the
+        // flat layout is ordered by id. Holders of pointer-to-member-function
+        // types get no entry of their own, see print_record_type.
+        if (TREE_CODE (node) == RECORD_TYPE && TYPE_PTRMEMFUNC_P (node))
+            node = TYPE_PTRMEMFUNC_FN_TYPE (node);
+        auto& entry = nodes.get (node);
+        if (!entry.id) {
+            entry.id = make_tree_id (node);
+            entry.visited = true;
+            flat_queue.push_back (node);
+        } // if
+        return output_id (entry.id);
+    } // flat_id
+
+    static unsigned int
+    get_tree_id (const_tree node)
+    {
+        // Nodes normally get their ids in call_printer or flat_id
+        auto& entry = nodes.get (node);
+        if (!entry.id)
+            entry.id = make_tree_id (node);
+        return entry.id;
+    } // get_tree_id
+
     static JSONRawString
     get_int_value (const_tree cst)
     {
@@ -316,85 +647,418 @@ namespace treecreeper {
             return nullptr;
     } // get_tree_name_ptr
 
-    static std::string
-    make_description (const_tree node)
+    static std::uint64_t
+    hash_mix (std::uint64_t seed, std::uint64_t value)
+    {
+        // Combine, then scramble with the finalizer of splitmix64
+        std::uint64_t x = seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    } // hash_mix
+
+    static std::uint64_t
+    hash_node (const_tree node)
     {
+        // Types are described down to this depth
+        static const int type_depth = 3;
+
+        // Hash what identifies the node in any unit: its code, qualified
+        // name, location and type. Locations are expanded, because their
+        // numbers depend on everything included before.
         if (!node)
-            return "<Null tree>";
+            return 0;
+        auto code = TREE_CODE (node);
+        std::uint64_t hash = hash_mix (0, code + 1);
+
+        // Anonymous types are located by their stub declarations
+        const_tree decl = nullptr;
+        if (DECL_P (node))
+            decl = node;
+        else if (TYPE_P (node) && TYPE_NAME (node) && DECL_P (TYPE_NAME (node)))
+            decl = TYPE_NAME (node);
+        else if (TYPE_P (node) && TYPE_STUB_DECL (node) && DECL_P (TYPE_STUB_DECL (node)))
+            decl = TYPE_STUB_DECL (node);
+        if (decl) {
+            expanded_location locx = resolve_location (DECL_SOURCE_LOCATION (decl));
+            hash = hash_string (hash, locx.file);
+            hash = hash_mix (hash_mix (hash, locx.line), locx.column);
+        } // if
+
+        if (DECL_P (node)) {
+            hash = hash_string (hash, qualified_name (node).c_str ());
+            hash = hash_type (hash, TREE_TYPE (node), type_depth);
+        } else if (TYPE_P (node)) {
+            // The enclosing declaration or type tells apart anonymous types
+            // of the same shape. Enclosing types may be anonymous too. The
+            // unit itself differs from unit to unit.
+            const_tree context = TYPE_CONTEXT (node);
+            if (context && TYPE_P (context))
+                hash = hash_mix (hash, hash_node (context));
+            else if (context && TREE_CODE (context) != TRANSLATION_UNIT_DECL)
+                hash = hash_string (hash, qualified_name (context).c_str ());
+            hash = hash_type (hash, node, type_depth);
+        } else if (code == BLOCK) {
+            // Blocks are identified by their position in the enclosing
+            // function or block
+            const_tree parent = BLOCK_SUPERCONTEXT (node);
+            const_tree first = nullptr;
+            if (parent && TREE_CODE (parent) == BLOCK)
+                first = BLOCK_SUBBLOCKS (parent);
+            else if (parent && TREE_CODE (parent) == FUNCTION_DECL)
+                first = DECL_INITIAL (parent);
+            std::uint64_t position = 0;
+            for (const_tree block = first; block && block != node;
+                 block = BLOCK_CHAIN (block))
+                position++;
+            hash = hash_mix (hash_mix (hash, hash_node (parent)), position);
+        } else if (code == IDENTIFIER_NODE)
+            hash = hash_string (hash, IDENTIFIER_POINTER (node));
+        else if (code == INTEGER_CST) {
+            hash = hash_string (hash, get_int_value (node).get_str_ref ().c_str ());
+            hash = hash_type (hash, TREE_TYPE (node), 0);
+        } else if (code == STRING_CST) {
+            hash = hash_string (hash, TREE_STRING_POINTER (node));
+            hash = hash_type (hash, TREE_TYPE (node), 0);
+        } else if (CODE_CONTAINS_STRUCT (code, TS_TYPED))
+            hash = hash_type (hash, TREE_TYPE (node), 0);
+        return hash;
+    } // hash_node
+
+    static std::uint64_t
+    hash_string (std::uint64_t seed, const char* str)
+    {
+        // FNV-1a
+        std::uint64_t hash = 0xcbf29ce484222325ull;
+        for (; str && *str; str++)
+            hash = (hash ^ static_cast<unsigned char> (*str)) * 0x100000001b3ull;
+        return hash_mix (seed, hash);
+    } // hash_string
+
+    static std::uint64_t
+    hash_type (std::uint64_t seed, const_tree type, int depth)
+    {
+        // Structural signature: code, name, qualifiers and precision of the
+        // type and of the types it is made of. Anonymous records and
+        // enumerations are described by their members instead of a name.
+        if (!type)
+            return hash_mix (seed, 0);
+
+        const bool anonymous = is_anonymous (type);
+        std::string name = anonymous ? std::string () : qualified_name (type);
+        seed = hash_mix (seed, TREE_CODE (type) + 1);
+        seed = hash_string (seed, name.c_str ());
+        seed = hash_mix (seed, TYPE_QUALS (type));
+        seed = hash_mix (seed, TYPE_PRECISION (type));
+        if (depth == 0)
+            return seed;
+
+        switch (TREE_CODE (type)) {
+        case ENUMERAL_TYPE:
+            if (anonymous) {
+                for (const_tree value = TYPE_VALUES (type); value;
+                     value = TREE_CHAIN (value))
+                    seed = hash_string (seed, get_tree_name_ptr (TREE_PURPOSE (value)));
+            } // if
+            break;
+
+        case RECORD_TYPE:
+        case UNION_TYPE:
+        case QUAL_UNION_TYPE:
+            if (anonymous) {
+                for (const_tree field = TYPE_FIELDS (type); field;
+                     field = TREE_CHAIN (field)) {
+                    if (TREE_CODE (field) != FIELD_DECL)
+                        continue;
+                    seed = hash_string (seed, get_tree_name_ptr (field));
+                    seed = hash_type (seed, TREE_TYPE (field), depth - 1);
+                } // for
+            } // if
+            break;
+
+        case ARRAY_TYPE:
+        case COMPLEX_TYPE:
+        case POINTER_TYPE:
+        case REFERENCE_TYPE:
+        case VECTOR_TYPE:
+            seed = hash_type (seed, TREE_TYPE (type), depth - 1);
+            break;
+
+        case FUNCTION_TYPE:
+        case METHOD_TYPE:
+            seed = hash_type (seed, TREE_TYPE (type), depth - 1);
+            for (tree arg = TYPE_ARG_TYPES (type); arg; arg = TREE_CHAIN (arg))
+                seed = hash_type (seed, TREE_VALUE (arg), depth - 1);
+            break;
+
+        default:
+            break;
+        } // switch
+        return seed;
+    } // hash_type
+
+    static void
+    describe (const_tree node, const char*& text, size_t& length)
+    {
+        ProfileScope scope (describe_profile);
+
+        // Types are described again and again, so remember their descriptions.
+        const bool is_type = TREE_CODE_CLASS (TREE_CODE (node)) == tcc_type;
+        if (is_type) {
+            auto it = type_descriptions.find (node);
+            if (it != type_descriptions.end ()) {
+                text = it->second.data ();
+                length = it->second.size ();
+                return;
+            } // if
+        } // if
 
-        char* buffer;
-        size_t size;
-        FILE* memstream = open_memstream (&buffer, &size);
+        format_description (node, text, length);
+        if (is_type) {
+            auto& cached = type_descriptions[node];
+            cached.assign (text, length);
+            text = cached.data ();
+        } // if
+    } // describe
 
-        pretty_printer pp;
-        pp_translate_identifiers (&pp) = false;
-        pp.buffer->stream = memstream;
+    static void
+    format_description (const_tree node, const char*& text, size_t& length)
+    {
+        // Printer and its output area are reused for all descriptions.
+        static pretty_printer* pp = nullptr;
+        if (!pp) {
+            pp = new pretty_printer ();
+            pp_translate_identifiers (pp) = false;
+        } // if
 
+        pp_clear_output_area (pp);
         if (TREE_CODE_CLASS (TREE_CODE (node)) == tcc_declaration
             && TREE_CODE (node) != TRANSLATION_UNIT_DECL)
-            print_declaration (&pp, const_cast<tree> (node), 0, 0);
+            print_declaration (pp, const_cast<tree> (node), 0, 0);
         else
-            dump_generic_node (&pp, const_cast<tree> (node), 0, 0, false);
-
-        pp_flush (&pp);
-        fclose (memstream);
+            dump_generic_node (pp, const_cast<tree> (node), 0, 0, false);
 
-        if (!buffer)
-            throw std::bad_alloc ();
+        text = pp_formatted_text (pp);
+        length = std::strlen (text);
 
         // Remove unwanted trailing characters
-        char* printable_buffer = buffer;
-        while (size > 0) {
-            size--;
-            char c = buffer[size];
-            if (c <= ' ' || c == ';')
-                continue;
-            else {
-                buffer[size + 1] = '\0';
-                break;
-            } // if
-        } // while
+        while (length > 0 && (static_cast<unsigned char> (text[length - 1]) <= ' '
+                              || text[length - 1] == ';'))
+            length--;
 
         // Remove preceding whitespace (this occurs in the name of the global namespace)
-        while (*printable_buffer == ' ') printable_buffer++;
+        while (length > 0 && *text == ' ') {
+            text++;
+            length--;
+        } // while
+    } // format_description
 
-        std::string result = printable_buffer;
-        free (buffer);
-        return result;
+    static unsigned int
+    intern_file (const char* name, bool system_header)
+    {
+        auto index = file_indices.find (name);
+        if (index != file_indices.end ())
+            return index->second;
+
+        // Maps of the same file usually share the name, but compare the
+        // names anyway.
+        auto result = file_indices_by_name.emplace (name, files.size ());
+        if (result.second)
+            files.emplace_back (name, system_header);
+        file_indices[name] = result.first->second;
+        return result.first->second;
+    } // intern_file
+
+    static bool
+    is_anonymous (const_tree type)
+    {
+        // The C++ frontend names anonymous types with a counter, see
+        // ANON_AGGRNAME_FORMAT, so the names depend on what came before
+        const char* name = get_tree_name_ptr (type);
+        return !name || !std::strncmp (name, "._", 2) || !std::strncmp (name, "$_", 2)
+            || !std::strncmp (name, "__anon_", 7);
+    } // is_anonymous
+
+    static bool
+    is_file_scope (const_tree node)
+    {
+        const_tree context;
+        if (DECL_P (node))
+            context = DECL_CONTEXT (node);
+        else if (TYPE_P (node))
+            context = TYPE_CONTEXT (node);
+        else
+            return false;
+
+        return !context || TREE_CODE (context) == TRANSLATION_UNIT_DECL
+            || TREE_CODE (context) == NAMESPACE_DECL;
+    } // is_file_scope
+
+    static bool
+    is_file_wanted (const char* file, bool system_header)
+    {
+        // Built-in declarations are governed by the builtins argument only
+        if (!file)
+            return true;
+        if (system_header && !options.system_headers)
+            return false;
+        if (options.include_files.empty () && options.exclude_files.empty ())
+            return true;
+
+        auto cached = file_filters.find (file);
+        if (cached != file_filters.end ())
+            return cached->second;
+
+        bool wanted = (options.include_files.empty ()
+                       || matches_any (options.include_files, file))
+            && !matches_any (options.exclude_files, file);
+        file_filters.emplace (file, wanted);
+        return wanted;
+    } // is_file_wanted
+
+    static bool
+    is_filtered (const_tree node)
+    {
+        // True for declarations and named types which the filters drop.
+        // They are still printed when a kept node refers to them.
+        if (options.include_files.empty () && options.exclude_files.empty ()
+            && options.include_namespaces.empty () && options.exclude_namespaces.empty ()
+            && options.system_headers)
+            return false;
+
+        const_tree decl = nullptr;
+        if (DECL_P (node))
+            decl = node;
+        else if (TYPE_P (node) && TYPE_NAME (node) && DECL_P (TYPE_NAME (node)))
+            decl = TYPE_NAME (node);
+        else
+            return false;
+
+        // Namespaces span files, so only the namespace filters apply
+        if (TREE_CODE (decl) == NAMESPACE_DECL)
+            return !filter_namespace (decl).traversed;
+
+        expanded_location locx = resolve_location (DECL_SOURCE_LOCATION (decl));
+        if (!is_file_wanted (locx.file, locx.sysp))
+            return true;
+
+        const_tree context = DECL_CONTEXT (decl);
+        while (context && TREE_CODE (context) != NAMESPACE_DECL) {
+            if (DECL_P (context))
+                context = DECL_CONTEXT (context);
+            else if (TYPE_P (context))
+                context = TYPE_CONTEXT (context);
+            else
+                context = nullptr;
+        } // while
+        const NamespaceFilter& filter = filter_namespace (context);
+        return !filter.included || filter.excluded;
+    } // is_filtered
+
+    static bool
+    is_root (const_tree node)
+    {
+        // Any file or namespace scope declaration but a namespace may be a
+        // root
+        if (!DECL_P (node) || TREE_CODE (node) == NAMESPACE_DECL)
+            return false;
+        if (!options.builtins && DECL_IS_BUILTIN (node))
+            return false;
+        return !is_filtered (node)
+            && matches_any (options.roots, qualified_name (node).c_str ());
+    } // is_root
+
+    static bool
+    is_incomplete (const_tree node)
+    {
+        // Nodes which records mode prints again when they are finished
+        if (TYPE_P (node))
+            return !COMPLETE_TYPE_P (node);
+        else if (TREE_CODE (node) == FUNCTION_DECL)
+            return !TREE_STATIC (node);
+        return false;
+    } // is_incomplete
+
+    static std::string
+    make_description (const_tree node)
+    {
+        if (!node)
+            return "<Null tree>";
+
+        const char* text;
+        size_t length;
+        describe (node, text, length);
+        return std::string (text, length);
     } // make_description
 
+    static std::uint64_t
+    make_stable_id (const_tree node)
+    {
+        // Stable ids are limited to 53 bits, so that they are exact as
+        // doubles in JSON consumers
+        static const std::uint64_t mask = (std::uint64_t (1) << 53) - 1;
+
+        // Only true collisions and nodes with nothing to tell them apart,
+        // such as equal constants, are numbered in the order they are
+        // reached. Their ids are stable only within the unit.
+        std::uint64_t hash = hash_node (node) & mask;
+        while (!hash || !used_stable_ids.insert (hash).second)
+            hash = hash_mix (hash, 1) & mask;
+        return hash;
+    } // make_stable_id
+
     static int
-    make_tree_id (const_tree node __attribute__ ((unused)))
+    make_tree_id (const_tree node)
     {
         static int id = 1;
+        if (options.ids == IdFormat::Stable) {
+            if (stable_ids.empty ())
+                stable_ids.push_back (0);
+            stable_ids.push_back (make_stable_id (node));
+        } // if
         return id++;
     } // make_tree_id
 
+    static bool
+    matches_any (const std::vector<std::string>& patterns, const char* str)
+    {
+        for (auto& pattern : patterns) {
+            if (!fnmatch (pattern.c_str (), str, 0))
+                return true;
+        } // for
+        return false;
+    } // matches_any
+
     static void
-    print_common_constant (JSONStream& stream, const_tree cst)
+    print_common_constant (OutputStream& stream, const_tree cst)
     {
         print_common_tree (stream, cst);
-        stream["type"] << TREE_TYPE (cst);
+        if (want (FIELD_TYPE))
+            stream["type"_key] << TREE_TYPE (cst);
     } // print_common_constant
 
     static void
-    print_common_declaration (JSONStream& stream, const_tree decl)
+    print_common_declaration (OutputStream& stream, const_tree decl)
     {
         // anonymous_namespace_name from gcc is static, so redefine it here.
         static const_tree anonymous_namespace_name = get_identifier ("_GLOBAL__N_1");
 
         print_common_tree (stream, decl);
 
-        auto name = DECL_NAME (decl);
-        if (name == anonymous_namespace_name)
-            name = NULL_TREE;
-        stream["name"] << name;
+        if (want (FIELD_NAME)) {
+            auto name = DECL_NAME (decl);
+            if (name == anonymous_namespace_name)
+                name = NULL_TREE;
+            stream["name"_key] << name;
+        } // if
 
-        stream["language"];
-        if (in_cxx)
-            stream << language_to_string (DECL_LANGUAGE (decl));
-        else
-            stream << "C";
+        if (want (FIELD_LANGUAGE)) {
+            stream["language"_key];
+            if (in_cxx)
+                stream << language_to_string (DECL_LANGUAGE (decl));
+            else
+                stream << "C";
+        } // if
 
         auto code = TREE_CODE (decl);
         const bool is_const = code == CONST_DECL;
@@ -405,31 +1069,37 @@ namespace treecreeper {
         const bool is_type = code == TYPE_DECL;
         const bool is_var = code == VAR_DECL;
 
-        if (is_func || is_var)
-            stream["assembler name"] << DECL_ASSEMBLER_NAME (const_cast<tree> (decl));
+        if ((is_func || is_var) && want (FIELD_NAME))
+            stream["assembler name"_key] << DECL_ASSEMBLER_NAME (const_cast<tree> (decl));
 
-        stream["context"] << DECL_CONTEXT (decl);
-        if (DECL_ABSTRACT_ORIGIN (decl))
-            stream["abstract origin"] << DECL_ABSTRACT_ORIGIN (decl);
-        stream["artificial"] << bool (DECL_ARTIFICIAL (decl));
-        stream["built-in"] << bool (DECL_IS_BUILTIN (decl));
+        if (want (FIELD_CONTEXT)) {
+            stream["context"_key] << DECL_CONTEXT (decl);
+            if (DECL_ABSTRACT_ORIGIN (decl))
+                stream["abstract origin"_key] << DECL_ABSTRACT_ORIGIN (decl);
+        } // if
+
+        if (want (FIELD_ATTRIBUTES)) {
+            stream["artificial"_key] << bool (DECL_ARTIFICIAL (decl));
+            stream["built-in"_key] << bool (DECL_IS_BUILTIN (decl));
+        } // if
 
-        print_location (stream["location"], DECL_SOURCE_LOCATION (decl));
+        if (want (FIELD_LOCATION))
+            print_location (stream["location"_key], DECL_SOURCE_LOCATION (decl));
 
         const bool has_size_info =
             (is_field || is_parm || is_result || is_var);
 
-        if (has_size_info) {
-            stream["size"] << get_int_value (DECL_SIZE (decl));
-            stream["alignment"] << DECL_ALIGN (decl);
+        if (has_size_info && want (FIELD_SIZE)) {
+            stream["size"_key] << get_int_value (DECL_SIZE (decl));
+            stream["alignment"_key] << DECL_ALIGN (decl);
         } // if
 
         const bool has_qualifiers = has_size_info || is_func || is_result;
         const bool has_static_extern = is_func || is_parm || is_var;
 
         // Qualifiers
-        if (has_qualifiers) {
-            stream["qualifiers"].new_array (true);
+        if (has_qualifiers && want (FIELD_QUALIFIERS)) {
+            stream["qualifiers"_key].new_array (true);
             if (has_static_extern && DECL_THIS_STATIC (decl))
                 stream << "static";
             if (has_static_extern && DECL_THIS_EXTERN (decl))
@@ -446,8 +1116,8 @@ namespace treecreeper {
         const bool has_access_info = (has_qualifiers || is_const || is_type
                                       || code == NAMESPACE_DECL);
 
-        if (has_access_info) {
-            stream["access"];
+        if (has_access_info && want (FIELD_ACCESS)) {
+            stream["access"_key];
             if (TREE_PRIVATE (decl))
                 stream << "private";
             else if (TREE_PROTECTED (decl))
@@ -458,84 +1128,101 @@ namespace treecreeper {
                 stream << "local";
         } // if
 
-        if (is_func || is_var) {
+        if ((is_func || is_var) && want (FIELD_VISIBILITY)) {
             print_common_visibility (stream, decl);
         } // if
     } // print_common_declaration
 
     static void
-    print_common_description (JSONStream& stream, const_tree node)
+    print_common_description (OutputStream& stream, const_tree node)
     {
-        stream["description"];
-        std::string data = make_description (node);
-        if (!data.empty ())
-            stream << data;
+        stream["description"_key];
+
+        const char* text;
+        size_t length;
+        describe (node, text, length);
+        if (length > 0)
+            stream.write_string (text, length);
         else
             stream << Null;
     } // print_common_description
 
     static void
-    print_common_precision (JSONStream& stream, const_tree type)
+    print_common_precision (OutputStream& stream, const_tree type)
     {
         print_common_type (stream, type);
-        stream["precison"] << TYPE_PRECISION (type);
+        if (want (FIELD_SIZE))
+            stream["precison"_key] << TYPE_PRECISION (type);
     } // print_common_precision
 
     static void
-    print_common_tree (JSONStream& stream, const_tree node, bool supported)
+    print_common_tree (OutputStream& stream, const_tree node, bool supported)
     {
-        stream["kind"];
+        stream["kind"_key];
         if (supported)
             stream << "gcc_tree";
         else
             stream << "unsupported_gcc_tree";
 
-        stream["id"] << tree_id_map[node];
-        stream["node type"] << get_tree_code_name (TREE_CODE (node));
-        print_common_description (stream, node);
+        stream["id"_key] << output_id (get_tree_id (node));
+        stream["node type"_key] << get_tree_code_name (TREE_CODE (node));
+        if (want (FIELD_DESCRIPTION))
+            print_common_description (stream, node);
     } // print_common_tree
 
     static void
-    print_common_type (JSONStream& stream, const_tree type)
+    print_common_type (OutputStream& stream, const_tree type)
     {
         print_common_tree (stream, type);
 
-        stream["name"] << get_tree_name_ptr (type);
-        stream["context"] << TYPE_CONTEXT (type);
+        if (want (FIELD_NAME))
+            print_name (stream["name"_key], get_tree_name_ptr (type));
+        if (want (FIELD_CONTEXT))
+            stream["context"_key] << TYPE_CONTEXT (type);
 
-        const_tree decl = TYPE_NAME (type);
-        stream["declaration"];
-        if (decl && TREE_CODE (decl) != IDENTIFIER_NODE)
-            stream << decl;
-        else
-            stream << Null;
+        if (want (FIELD_TYPE)) {
+            const_tree decl = TYPE_NAME (type);
+            stream["declaration"_key];
+            if (decl && TREE_CODE (decl) != IDENTIFIER_NODE)
+                stream << decl;
+            else
+                stream << Null;
+        } // if
 
-        stream["complete"] << bool (COMPLETE_TYPE_P (type));
-        stream["size"] << get_int_value (TYPE_SIZE (type));
-        stream["alignment"] << TYPE_ALIGN (type);
-        stream["user alignment"] << bool (TYPE_USER_ALIGN (type));
+        if (want (FIELD_ATTRIBUTES))
+            stream["complete"_key] << bool (COMPLETE_TYPE_P (type));
+
+        if (want (FIELD_SIZE)) {
+            stream["size"_key] << get_int_value (TYPE_SIZE (type));
+            stream["alignment"_key] << TYPE_ALIGN (type);
+            stream["user alignment"_key] << bool (TYPE_USER_ALIGN (type));
+        } // if
 
         // Qualifiers
-        stream["qualifiers"].new_array (true);
-        auto qualifiers = TYPE_QUALS (type);
+        if (want (FIELD_QUALIFIERS)) {
+            stream["qualifiers"_key].new_array (true);
+            auto qualifiers = TYPE_QUALS (type);
 
-        if (qualifiers & TYPE_QUAL_ATOMIC)
-            stream << "atomic";
+            if (qualifiers & TYPE_QUAL_ATOMIC)
+                stream << "atomic";
 
-        if (qualifiers & TYPE_QUAL_CONST)
-            stream << "const";
+            if (qualifiers & TYPE_QUAL_CONST)
+                stream << "const";
 
-        if (qualifiers & TYPE_QUAL_RESTRICT)
-            stream << "restrict";
+            if (qualifiers & TYPE_QUAL_RESTRICT)
+                stream << "restrict";
 
-        if (qualifiers & TYPE_QUAL_VOLATILE)
-            stream << "volatile";
+            if (qualifiers & TYPE_QUAL_VOLATILE)
+                stream << "volatile";
 
-        stream.end_array ();
+            stream.end_array ();
+        } // if
 
-        stream["needs constuccting"] << bool (TYPE_NEEDS_CONSTRUCTING (type));
+        if (want (FIELD_ATTRIBUTES))
+            stream["needs constuccting"_key] << bool (TYPE_NEEDS_CONSTRUCTING (type));
 
-        stream["main variant"] << TYPE_MAIN_VARIANT (type);
+        if (want (FIELD_TYPE))
+            stream["main variant"_key] << TYPE_MAIN_VARIANT (type);
 
         // Don't print NEXT_VARIANT, because its mostly useless and makes the
         // output hard to read. However, remember it so that we can pritnt it
@@ -544,10 +1231,10 @@ namespace treecreeper {
     } // print_common_type
 
     static void
-    print_common_visibility (JSONStream& stream, const_tree decl)
+    print_common_visibility (OutputStream& stream, const_tree decl)
     {
-        stream["weak linkage"] << bool (DECL_WEAK (decl));
-        stream["visibility"];
+        stream["weak linkage"_key] << bool (DECL_WEAK (decl));
+        stream["visibility"_key];
         switch (DECL_VISIBILITY (decl)) {
         case VISIBILITY_DEFAULT:
             stream << "default";
@@ -567,18 +1254,22 @@ namespace treecreeper {
     } // print_common_visibility
 
     static void
-    print_complex_constant (JSONStream& stream, const_tree cst)
+    print_complex_constant (OutputStream& stream, const_tree cst)
     {
         stream.new_object ();
         print_common_constant (stream, cst);
-        stream["real part"] << TREE_REALPART (cst);
-        stream["imaginary part"] << TREE_IMAGPART (cst);
+        if (want (FIELD_VALUES)) {
+            stream["real part"_key] << TREE_REALPART (cst);
+            stream["imaginary part"_key] << TREE_IMAGPART (cst);
+        } // if
         stream.end_object ();
     } // print_complex_constant
 
     static void
-    print_all_macros (JSONStream& stream)
+    print_all_macros (OutputStream& stream)
     {
+        ProfileScope scope (phase_profiles[PHASE_MACROS], &stream);
+        auto_client_timevar timevar ("treecreeper macros");
         stream.new_array ();
         cpp_forall_identifiers
             (parse_in, print_macro, &stream);
@@ -586,7 +1277,7 @@ namespace treecreeper {
     } // print_all_macros
 
     static void
-    print_all_translation_units (JSONStream& stream)
+    print_all_translation_units (OutputStream& stream)
     {
         // NOTE: We assume that stream is in array state!
         if (!all_translation_units) {
@@ -599,20 +1290,24 @@ namespace treecreeper {
     } // print_all_translation_units
 
     static void
-    print_array_type (JSONStream& stream, const_tree type)
+    print_array_type (OutputStream& stream, const_tree type)
     {
         stream.new_object ();
         print_common_type (stream, type);
 
-        stream["element type"] << TREE_TYPE (type);
-        stream["index type"] << TYPE_DOMAIN (type);
-        stream["is string"] << bool (TYPE_STRING_FLAG (type));
-        stream["aliased components"] << !bool (TYPE_NONALIASED_COMPONENT (type));
+        if (want (FIELD_TYPE)) {
+            stream["element type"_key] << TREE_TYPE (type);
+            stream["index type"_key] << TYPE_DOMAIN (type);
+        } // if
+        if (want (FIELD_ATTRIBUTES)) {
+            stream["is string"_key] << bool (TYPE_STRING_FLAG (type));
+            stream["aliased components"_key] << !bool (TYPE_NONALIASED_COMPONENT (type));
+        } // if
         stream.end_object ();
     } // print_array_type
 
     static void
-    print_block (JSONStream& stream, const_tree block)
+    print_block (OutputStream& stream, const_tree block)
     {
         stream.new_object ();
         print_common_tree (stream, block);
@@ -626,221 +1321,336 @@ namespace treecreeper {
             } // if
         } // for
 
-        stream["declarations"].new_array ();
+        stream["declarations"_key].new_array ();
         for (auto decl : decls)
             stream << decl;
         stream.end_array ();
 
-        stream["context"] << BLOCK_SUPERCONTEXT (block);
+        if (want (FIELD_CONTEXT))
+            stream["context"_key] << BLOCK_SUPERCONTEXT (block);
 
-        stream["subblocks"].new_array ();
-        for (tree node = BLOCK_SUBBLOCKS (block); node; node = BLOCK_CHAIN (node)) {
-            stream << node;
-        } // for
+        // Subblocks are listed one by one, not as block lists
+        stream["subblocks"_key].new_array ();
+        for (tree node = BLOCK_SUBBLOCKS (block); node; node = BLOCK_CHAIN (node))
+            call_printer (stream, print_block, node);
         stream.end_array ();
         stream.end_object ();
     } // print_block
 
     static void
-    print_block_list (JSONStream& stream, const_tree block)
+    print_block_list (OutputStream& stream, const_tree block)
     {
-        // This function must not use << or call_printer to print blocks.
+        // In the flat layout each block is a node of its own, and the list
+        // is written as their ids
+        if (options.layout == Layout::Flat) {
+            stream.new_array (true);
+            for (const_tree node = block; node; node = BLOCK_CHAIN (node))
+                stream << flat_id (node);
+            stream.end_array ();
+            return;
+        } // if
+
+        // This function is the printer of the first block, so it must print
+        // that block directly. The blocks chained to it get their ids and
+        // are printed or referred to through call_printer.
         stream.new_array ();
-        for (const_tree node = block; node; node = BLOCK_CHAIN (node)) {
-            print_block (stream, node);
-        } // for
+        print_block (stream, block);
+        for (const_tree node = BLOCK_CHAIN (block); node; node = BLOCK_CHAIN (node))
+            call_printer (stream, print_block, node);
         stream.end_array ();
     } // print_block_list
 
     static void
-    print_complex_type (JSONStream& stream, const_tree type)
+    print_complex_type (OutputStream& stream, const_tree type)
     {
         stream.new_object ();
         print_common_type (stream, type);
 
-        stream["component type"] << TREE_TYPE (type);
+        if (want (FIELD_TYPE))
+            stream["component type"_key] << TREE_TYPE (type);
         stream.end_object ();
     } // print_complex_type
 
     static void
-    print_const_decl (JSONStream& stream, const_tree decl)
+    print_const_decl (OutputStream& stream, const_tree decl)
     {
         stream.new_object ();
         print_common_declaration (stream, decl);
 
-        stream["type"] << TREE_TYPE (decl);
-        stream["value"] << DECL_INITIAL (decl);
+        if (want (FIELD_TYPE))
+            stream["type"_key] << TREE_TYPE (decl);
+        if (want (FIELD_VALUES))
+            stream["value"_key] << DECL_INITIAL (decl);
         stream.end_object ();
     } // print_const_decl
 
     static void
-    print_enumeral_type (JSONStream& stream, const_tree type)
+    print_enumeral_type (OutputStream& stream, const_tree type)
     {
         stream.new_object ();
         print_common_precision (stream, type);
 
-        stream["scpoped"] << bool (ENUM_IS_SCOPED (type));
-        stream["sign"] << TYPE_SIGN (type);
-        stream["minimum value"] << TYPE_MIN_VALUE (type);
-        stream["maximum value"] << TYPE_MAX_VALUE (type);
-
-        stream["values"].new_array ();
-        // Here C and C++ deviate: in C TREE_VALUE gives the enumeration value
-        // as a integer constant, whereas in C++ it is a CONST_DECL node. We
-        // unify this behaviour by collecting all CONST_DECL nodes beforehand
-        // and looking them up here.
-        for (auto elem = TYPE_VALUES (type); elem; elem = TREE_CHAIN (elem)) {
-            auto value = TREE_VALUE (elem);
-            if (TREE_CODE (value) == CONST_DECL)
-                stream << value;
-            else
-                stream << find_const_decl (type, elem);
-        } // for
-        stream.end_array ();
+        if (want (FIELD_ATTRIBUTES))
+            stream["scpoped"_key] << bool (ENUM_IS_SCOPED (type));
+        if (want (FIELD_SIZE))
+            stream["sign"_key] << TYPE_SIGN (type);
+
+        if (want (FIELD_VALUES)) {
+            stream["minimum value"_key] << TYPE_MIN_VALUE (type);
+            stream["maximum value"_key] << TYPE_MAX_VALUE (type);
+
+            stream["values"_key].new_array ();
+            // Here C and C++ deviate: in C TREE_VALUE gives the enumeration
+            // value as a integer constant, whereas in C++ it is a CONST_DECL
+            // node. We unify this behaviour by collecting all CONST_DECL nodes
+            // beforehand and looking them up here.
+            for (auto elem = TYPE_VALUES (type); elem; elem = TREE_CHAIN (elem)) {
+                auto value = TREE_VALUE (elem);
+                if (TREE_CODE (value) == CONST_DECL)
+                    stream << value;
+                else
+                    stream << find_const_decl (type, elem);
+            } // for
+            stream.end_array ();
+        } // if
         stream.end_object ();
     } // print_enumeral_type
 
     static void
-    print_field_decl (JSONStream& stream, const_tree decl)
+    print_field_decl (OutputStream& stream, const_tree decl)
     {
         stream.new_object ();
         print_common_declaration (stream, decl);
 
-        stream["type"] << TREE_TYPE (decl);
-        stream["declaring class"] << DECL_FIELD_CONTEXT (decl);
+        if (want (FIELD_TYPE))
+            stream["type"_key] << TREE_TYPE (decl);
+        if (want (FIELD_CONTEXT))
+            stream["declaring class"_key] << DECL_FIELD_CONTEXT (decl);
 
-        stream["unit offset"] << DECL_FIELD_OFFSET (decl);
-        stream["unit size"] << DECL_OFFSET_ALIGN (decl);
-        stream["bit offset"] << get_int_value (DECL_FIELD_BIT_OFFSET (decl));
-        stream["bit-field"] << bool (DECL_C_BIT_FIELD (decl));
-        if (DECL_C_BIT_FIELD (decl))
-            stream["bit-field type"] << DECL_BIT_FIELD_TYPE (decl);
-
-        stream["packed"] << bool (DECL_PACKED (decl));
-        stream["mutable"] << bool (DECL_MUTABLE_P (decl));
+        if (want (FIELD_SIZE)) {
+            stream["unit offset"_key] << DECL_FIELD_OFFSET (decl);
+            stream["unit size"_key] << DECL_OFFSET_ALIGN (decl);
+            stream["bit offset"_key] << get_int_value (DECL_FIELD_BIT_OFFSET (decl));
+        } // if
+        if (want (FIELD_ATTRIBUTES))
+            stream["bit-field"_key] << bool (DECL_C_BIT_FIELD (decl));
+        if (DECL_C_BIT_FIELD (decl) && want (FIELD_TYPE))
+            stream["bit-field type"_key] << DECL_BIT_FIELD_TYPE (decl);
+
+        if (want (FIELD_ATTRIBUTES)) {
+            stream["packed"_key] << bool (DECL_PACKED (decl));
+            stream["mutable"_key] << bool (DECL_MUTABLE_P (decl));
+        } // if
         stream.end_object ();
     } // print_field_decl
 
     static void
-    print_fixed_point_constant (JSONStream& stream, const_tree cst)
+    print_file_table (OutputStream& stream)
+    {
+        ProfileScope scope (phase_profiles[PHASE_FILES], &stream);
+        stream.new_array ();
+        for (auto& file : files) {
+            stream.new_object (true);
+            stream["name"_key] << file.first;
+            stream["system header"_key] << file.second;
+            stream.end_object ();
+        } // for
+        stream.end_array ();
+    } // print_file_table
+
+    static void
+    print_flat_layout (OutputStream& stream)
+    {
+        // Print nodes breadth first, so that printers only write the ids of
+        // the nodes they refer to.
+        std::vector<std::uint64_t> roots;
+        auto print_queued_nodes = [&stream] () {
+            while (!flat_queue.empty ()) {
+                // Every entry is an object, so blocks are printed one by one
+                // instead of as lists, see print_block_list
+                const_tree node = flat_queue.front ();
+                flat_queue.pop_front ();
+                tree_printer_func func = TREE_CODE (node) == BLOCK
+                    ? print_block : tree_printers.printers[TREE_CODE (node)];
+                print_node (stream, func, node);
+            } // while
+        };
+
+        stream["nodes"_key].new_array ();
+        if (!options.roots.empty ()) {
+            // Only what is reachable from the matching declarations
+            std::vector<const_tree> found;
+            collect_roots (found);
+            for (auto node : found)
+                roots.push_back (flat_id (node));
+            print_queued_nodes ();
+        } else {
+            if (all_translation_units) {
+                for (unsigned int j = 0; j < all_translation_units->length (); j++)
+                    roots.push_back (flat_id ((*all_translation_units)[j]));
+            } // if
+            if (global_namespace)
+                roots.push_back (flat_id (global_namespace));
+            print_queued_nodes ();
+
+            // Make sure that we did not miss a single declaration
+            std::vector<const_tree> pending;
+            for (collect_unvisited_nodes (pending); !pending.empty ();
+                 collect_unvisited_nodes (pending)) {
+                for (auto node : pending) {
+                    auto entry = nodes.find (node);
+                    if (entry && !entry->visited)
+                        roots.push_back (flat_id (node));
+                } // for
+                print_queued_nodes ();
+            } // for
+        } // if
+        stream.end_array ();
+
+        stream["declarations"_key].new_array (true);
+        for (auto id : roots)
+            stream << id;
+        stream.end_array ();
+    } // print_flat_layout
+
+    static void
+    print_fixed_point_constant (OutputStream& stream, const_tree cst)
     {
         stream.new_object ();
         print_common_constant (stream, cst);
 
-	char str[100];
-	fixed_to_decimal (str, TREE_FIXED_CST_PTR (cst), sizeof (str));
-	stream["value"] << str;
+        if (want (FIELD_VALUES)) {
+            char str[100];
+            fixed_to_decimal (str, TREE_FIXED_CST_PTR (cst), sizeof (str));
+            stream["value"_key] << str;
+        } // if
         stream.end_object ();
     } // print_fixed_point_constant
 
     static void
-    print_fixed_point_type (JSONStream& stream, const_tree type)
+    print_fixed_point_type (OutputStream& stream, const_tree type)
     {
         stream.new_object ();
         print_common_precision (stream, type);
 
-        stream["sign"] << TYPE_SIGN (type);
-        stream["fractional bits"] << TYPE_FBIT (type);
-        stream["integral bits"] << TYPE_IBIT (type);
-        stream["saturating"] << bool (TYPE_SATURATING (type));
+        if (want (FIELD_SIZE)) {
+            stream["sign"_key] << TYPE_SIGN (type);
+            stream["fractional bits"_key] << TYPE_FBIT (type);
+            stream["integral bits"_key] << TYPE_IBIT (type);
+        } // if
+        if (want (FIELD_ATTRIBUTES))
+            stream["saturating"_key] << bool (TYPE_SATURATING (type));
 
         stream.end_object ();
     } // print_fixed_point_type
 
     static void
-    print_function_decl (JSONStream& stream, const_tree decl)
+    print_function_decl (OutputStream& stream, const_tree decl)
     {
         stream.new_object ();
         print_common_declaration (stream, decl);
 
-        stream["function type"] << TREE_TYPE (decl);
-        stream["result"] << DECL_RESULT (decl);
+        if (want (FIELD_TYPE))
+            stream["function type"_key] << TREE_TYPE (decl);
 
-        stream["arguments"].new_array ();
-        for (tree arg = DECL_ARGUMENTS (decl); arg; arg = TREE_CHAIN (arg))
-            stream <<  arg;
-        stream.end_array ();
+        if (want (FIELD_ARGUMENTS)) {
+            stream["result"_key] << DECL_RESULT (decl);
 
-        stream["defined"] << bool (TREE_STATIC (decl));
-        stream["pure"] << bool (DECL_PURE_P (decl));
-        stream["read globals"] << bool (!DECL_IS_NOVOPS (decl));
-        stream["virtual"] << bool (DECL_VIRTUAL_P (decl));
-        if (DECL_VIRTUAL_P (decl)) {
-            stream["final"] << bool (DECL_FINAL_P (decl));
-            stream["vtable index"] << DECL_VINDEX (decl);
-        } // if
-
-        if (DECL_CONV_FN_P (decl))
-            stream["conversion target type"] << DECL_CONV_FN_TYPE (decl);
-
-        stream["construction role"];
-        if (DECL_STATIC_CONSTRUCTOR (decl))
-            stream << "static constructor";
-        else if (DECL_STATIC_DESTRUCTOR (decl))
-            stream << "static destructor";
-        else if (DECL_CONSTRUCTOR_P (decl))
-            stream << "constructor";
-        else if (DECL_CXX_DESTRUCTOR_P (decl))
-            stream << "destructor";
-        else
-            stream << Null;
+            stream["arguments"_key].new_array ();
+            for (tree arg = DECL_ARGUMENTS (decl); arg; arg = TREE_CHAIN (arg))
+                stream <<  arg;
+            stream.end_array ();
+        } // if
+
+        if (want (FIELD_ATTRIBUTES)) {
+            stream["defined"_key] << bool (TREE_STATIC (decl));
+            stream["pure"_key] << bool (DECL_PURE_P (decl));
+            stream["read globals"_key] << bool (!DECL_IS_NOVOPS (decl));
+            stream["virtual"_key] << bool (DECL_VIRTUAL_P (decl));
+            if (DECL_VIRTUAL_P (decl)) {
+                stream["final"_key] << bool (DECL_FINAL_P (decl));
+                stream["vtable index"_key] << DECL_VINDEX (decl);
+            } // if
+        } // if
 
-        if (DECL_CLONED_FUNCTION_P (decl))
-            stream["cloned function"] << DECL_CLONED_FUNCTION (decl);
+        if (DECL_CONV_FN_P (decl) && want (FIELD_TYPE))
+            stream["conversion target type"_key] << DECL_CONV_FN_TYPE (decl);
+
+        if (want (FIELD_ATTRIBUTES)) {
+            stream["construction role"_key];
+            if (DECL_STATIC_CONSTRUCTOR (decl))
+                stream << "static constructor";
+            else if (DECL_STATIC_DESTRUCTOR (decl))
+                stream << "static destructor";
+            else if (DECL_CONSTRUCTOR_P (decl))
+                stream << "constructor";
+            else if (DECL_CXX_DESTRUCTOR_P (decl))
+                stream << "destructor";
+            else
+                stream << Null;
+        } // if
+
+        if (DECL_CLONED_FUNCTION_P (decl) && want (FIELD_TYPE))
+            stream["cloned function"_key] << DECL_CLONED_FUNCTION (decl);
         stream.end_object ();
     } // print_function_decl
 
     static void
-    print_function_type (JSONStream& stream, const_tree type)
+    print_function_type (OutputStream& stream, const_tree type)
     {
         stream.new_object ();
         print_common_type (stream, type);
 
-        stream["result type"] << TREE_TYPE (type);
+        if (want (FIELD_TYPE)) {
+            stream["result type"_key] << TREE_TYPE (type);
 
-        if (TREE_CODE (type) == METHOD_TYPE)
-            stream["class type"] << TYPE_METHOD_BASETYPE (type);
+            if (TREE_CODE (type) == METHOD_TYPE)
+                stream["class type"_key] << TYPE_METHOD_BASETYPE (type);
+        } // if
 
-        stream["argument types"].new_array (true);
-        bool variadic = true;
-        for (tree arg = TYPE_ARG_TYPES (type); arg; arg = TREE_CHAIN (arg)) {
-            const_tree arg_value = TREE_VALUE (arg);
+        if (want (FIELD_ARGUMENTS)) {
+            stream["argument types"_key].new_array (true);
+            bool variadic = true;
+            for (tree arg = TYPE_ARG_TYPES (type); arg; arg = TREE_CHAIN (arg)) {
+                const_tree arg_value = TREE_VALUE (arg);
 
-            // Check the varidic argument case and omit the last void node
-            if (arg_value == void_type_node && !TREE_CHAIN (arg)) {
-                variadic = false;
-                break;
-            } // if
+                // Check the varidic argument case and omit the last void node
+                if (arg_value == void_type_node && !TREE_CHAIN (arg)) {
+                    variadic = false;
+                    break;
+                } // if
 
-            stream << arg_value;
-        } // for
-        stream.end_array ();
-        stream["variadic"] << variadic;
+                stream << arg_value;
+            } // for
+            stream.end_array ();
+            stream["variadic"_key] << variadic;
+        } // if
 
         stream.end_object ();
     } // print_function_type
 
     static void
-    print_identifier (JSONStream& stream, const_tree id)
+    print_identifier (OutputStream& stream, const_tree id)
     {
         if (IDENTIFIER_TRANSPARENT_ALIAS (id)) {
             stream.new_array (true);
-            for (auto& node = id; node; node = TREE_CHAIN (id))
-                stream << IDENTIFIER_POINTER (node);
+            for (auto node = id; node; node = TREE_CHAIN (node))
+                print_name (stream, IDENTIFIER_POINTER (node));
             stream.end_array ();
         } else if (IDENTIFIER_TYPENAME_P (id)) {
             stream.new_object ();
             print_common_tree (stream, id);
-            stream["conversion operator"] << true;
-            stream["target type"] << TREE_TYPE (id);
+            stream["conversion operator"_key] << true;
+            stream["target type"_key] << TREE_TYPE (id);
+            stream.end_object ();
+        } else if (!IDENTIFIER_OPNAME_P (id)) {
+            print_name (stream, IDENTIFIER_POINTER (id));
         } else {
+            // Operator names are not interned, as they are built here
             auto name = IDENTIFIER_POINTER (id);
-            std::string result;
-            if (IDENTIFIER_OPNAME_P (id)) {
-                result += "operator";
-                if (name)
-                    result += ' ';
-            } // if
+            std::string result = "operator";
+            if (name)
+                result += ' ';
 
             result += name;
             stream << result;
@@ -848,72 +1658,120 @@ namespace treecreeper {
     } // print_identifier
 
     static void
-    print_integer_constant (JSONStream& stream, const_tree cst)
+    print_index_entry (const_tree node, std::uint64_t offset, std::uint64_t length)
+    {
+        auto& index = *index_stream;
+        std::string name = qualified_name (node);
+
+        index.new_object ();
+        index["id"_key] << output_id (get_tree_id (node));
+        index["name"_key];
+        if (name.empty ())
+            index << Null;
+        else
+            index << name;
+        index["offset"_key] << offset;
+        index["length"_key] << length;
+        index.end_object ();
+    } // print_index_entry
+
+    static void
+    print_integer_constant (OutputStream& stream, const_tree cst)
     {
         stream.new_object ();
         print_common_constant (stream, cst);
-        stream["value"] << get_int_value (cst);
-        stream["overflow"] << bool (TREE_OVERFLOW (cst));
+        if (want (FIELD_VALUES)) {
+            stream["value"_key] << get_int_value (cst);
+            stream["overflow"_key] << bool (TREE_OVERFLOW (cst));
+        } // if
         stream.end_object ();
     } // print_integer_constant
 
     static void
-    print_integer_type (JSONStream& stream, const_tree type)
+    print_integer_type (OutputStream& stream, const_tree type)
     {
         stream.new_object ();
         print_common_precision (stream, type);
 
-        stream["sign"] << TYPE_SIGN (type);
-        stream["minimum value"] << TYPE_MIN_VALUE (type);
-        stream["maximum value"] << TYPE_MAX_VALUE (type);
-        stream["is character"] << bool (TYPE_STRING_FLAG (type));
+        if (want (FIELD_SIZE))
+            stream["sign"_key] << TYPE_SIGN (type);
+        if (want (FIELD_VALUES)) {
+            stream["minimum value"_key] << TYPE_MIN_VALUE (type);
+            stream["maximum value"_key] << TYPE_MAX_VALUE (type);
+        } // if
+        if (want (FIELD_ATTRIBUTES))
+            stream["is character"_key] << bool (TYPE_STRING_FLAG (type));
 
         stream.end_object ();
     } // print_integer_type
 
 
     static void
-    print_all_line_maps (JSONStream& stream)
+    print_all_line_maps (OutputStream& stream)
     {
+        // Whether each entered file is kept, innermost last. Includes of
+        // filtered files are listed in the nearest kept includer.
+        std::vector<bool> kept;
+        ProfileScope scope (phase_profiles[PHASE_INCLUDES], &stream);
+        auto_client_timevar timevar ("treecreeper line maps");
+
         stream.new_array ();
         for (unsigned int j = 0; j < LINEMAPS_ORDINARY_USED (line_table); j++) {
             line_map_ordinary* map = LINEMAPS_ORDINARY_MAP_AT (line_table, j);
-            print_line_map (stream, map);
+            print_line_map (stream, map, kept);
         } // for
         // Note that the first linemap does not have a corresponding LC_LEAVE
         // entry, so we have to close an array and object explicitly.
-        stream.end_array ();
-        stream.end_object ();
+        for (; !kept.empty (); kept.pop_back ()) {
+            if (kept.back ()) {
+                stream.end_array ();
+                stream.end_object ();
+            } // if
+        } // for
 
         // Now end the array that we started ourselves.
         stream.end_array ();
     } // print_all_line_maps
 
     static void
-    print_line_map (JSONStream& stream, line_map_ordinary* map)
+    print_line_map (OutputStream& stream, line_map_ordinary* map,
+                    std::vector<bool>& kept)
     {
+        ProfileScope scope (line_map_profile, &stream);
+
         switch (map->reason) {
         case LC_ENTER:
+            kept.push_back (is_file_wanted (ORDINARY_MAP_FILE_NAME (map),
+                                            ORDINARY_MAP_IN_SYSTEM_HEADER_P (map)));
+            if (!kept.back ())
+                break;
             stream.new_object ();
-            stream["kind"] << "gcc_include";
-            stream["include file"] << ORDINARY_MAP_FILE_NAME (map);
+            stream["kind"_key] << "gcc_include";
+            stream["include file"_key] << ORDINARY_MAP_FILE_NAME (map);
             print_line_map_location (stream, map);
-            stream["includes"].new_array ();
+            stream["includes"_key].new_array ();
             break;
         case LC_RENAME: case LC_RENAME_VERBATIM:
+            if (!kept.empty () && !kept.back ())
+                break;
             stream.new_object ();
-            stream["kind"] << "gcc_include";
-            stream["rename"].new_object (true);
-            stream["file"] << ORDINARY_MAP_FILE_NAME (map);
-            stream["line"] << ORDINARY_MAP_STARTING_LINE_NUMBER (map);
+            stream["kind"_key] << "gcc_include";
+            stream["rename"_key].new_object (true);
+            stream["file"_key] << ORDINARY_MAP_FILE_NAME (map);
+            stream["line"_key] << ORDINARY_MAP_STARTING_LINE_NUMBER (map);
             stream.end_object ();
 
             print_line_map_location (stream, map);
             stream.end_object ();
             break;
         case LC_LEAVE:
-            stream.end_array (); // End of actions array
-            stream.end_object (); // End of include file object
+            if (kept.empty ())
+                break;
+            if (kept.back ()) {
+                stream.end_array (); // End of actions array
+                stream.end_object (); // End of include file object
+            } // if
+            kept.pop_back ();
             break;
         default:
             ; // Don't care ???
@@ -921,14 +1779,14 @@ namespace treecreeper {
     } // print_line_map
 
     static void
-    print_line_map_location (JSONStream& stream, line_map_ordinary* map)
+    print_line_map_location (OutputStream& stream, line_map_ordinary* map)
     {
         unsigned int from_idx
             = ORDINARY_MAP_INCLUDER_FILE_INDEX (map);
         line_map_ordinary* from_map =
             (from_idx < LINEMAPS_ORDINARY_USED (line_table)
              ? LINEMAPS_ORDINARY_MAP_AT (line_table, from_idx) : nullptr);
-        stream["location"];
+        stream["location"_key];
         if (from_map)
             print_location (stream, from_map->start_location);
         else
@@ -936,7 +1794,7 @@ namespace treecreeper {
     } // print_line_map_from
 
     static void
-    print_location (JSONStream& stream, const source_location loc)
+    print_location (OutputStream& stream, const source_location loc)
     {
         if (loc == BUILTINS_LOCATION) {
             stream << "built-in";
@@ -946,18 +1804,34 @@ namespace treecreeper {
             return;
         } // if
 
-        expanded_location locx = expand_location (loc);
+        expanded_location locx = resolve_location (loc);
         if (!locx.file) {
             stream << Null;
             return;
         } // if
 
+        // Write locations in the file table as compact tuples. The table is
+        // built beforehand, except in records mode.
+        if (options.locations == LocationFormat::Table) {
+            auto index = file_indices.find (locx.file);
+            if (index != file_indices.end () || options.records) {
+                stream.new_array (true);
+                if (index != file_indices.end ())
+                    stream << index->second;
+                else
+                    stream << intern_file (locx.file, locx.sysp);
+                stream << locx.line << locx.column;
+                stream.end_array ();
+                return;
+            } // if
+        } // if
+
         stream.new_object (true);
-        stream["kind"] << "source_location";
-        stream["file"] << locx.file;
-        stream["line"] << locx.line;
-        stream["column"] << locx.column;
-        stream["system header"] << bool (locx.sysp);
+        stream["kind"_key] << "source_location";
+        stream["file"_key] << locx.file;
+        stream["line"_key] << locx.line;
+        stream["column"_key] << locx.column;
+        stream["system header"_key] << bool (locx.sysp);
         stream.end_object ();
     } // print_location
 
@@ -967,114 +1841,159 @@ namespace treecreeper {
         if (node->type != NT_MACRO || (node->flags & NODE_BUILTIN))
             return 1;
 
-        auto& stream = *static_cast<JSONStream*> (stream_ptr);
-        stream.new_object ();
-        stream["kind"] << "gcc_macro";
+        // Macros are filtered by the file which defines them
         const cpp_macro* macro = node->value.macro;
+        expanded_location locx = resolve_location (macro->line);
+        if (!is_file_wanted (locx.file, locx.sysp))
+            return 1;
 
-        stream["name"] << NODE_NAME (node);
-        print_location (stream["location"], macro->line);
+        auto& stream = *static_cast<OutputStream*> (stream_ptr);
+        ProfileScope scope (macro_profile, &stream);
+        stream.new_object ();
+        stream["kind"_key] << "gcc_macro";
 
-        stream["arguments"];
-        if (!macro->fun_like)
-            stream << Null;
-        else {
-            stream.new_array (true);
-            for (int j = 0; j < macro->paramc; j++) {
-                cpp_hashnode* arg = macro->params[j];
-                stream << NODE_NAME (arg);
-            } // for
-            stream.end_array ();
+        if (want (FIELD_NAME))
+            print_name (stream["name"_key], NODE_NAME (node));
+        if (want (FIELD_LOCATION))
+            print_location (stream["location"_key], macro->line);
 
-            stream["variadic"] << macro->variadic;
+        if (want (FIELD_ARGUMENTS)) {
+            stream["arguments"_key];
+            if (!macro->fun_like)
+                stream << Null;
+            else {
+                stream.new_array (true);
+                for (int j = 0; j < macro->paramc; j++) {
+                    cpp_hashnode* arg = macro->params[j];
+                    print_name (stream, NODE_NAME (arg));
+                } // for
+                stream.end_array ();
+
+                stream["variadic"_key] << macro->variadic;
+            } // if
         } // if
 
-        stream["tokens"].new_array ();
-        //unsigned int count = macro_real_token_count (macro); ???
-        for (unsigned int j = 0; j < macro->count; j++) {
-            cpp_token& token = macro->exp.tokens[j];
-
-            stream.new_object (true);
-            stream["kind"] << "gcc_macro_token";
-            stream["type"] << cpp_type2name (token.type, token.flags);
-
-            // Flags
-            stream["flags"].new_array (true);
-            if (token.flags & PREV_WHITE)
-                stream << "previous whitespace";
-            if (token.flags & DIGRAPH)
-                stream << "digraph";
-            if (token.flags & STRINGIFY_ARG)
-                stream << "stringify";
-            if (token.flags & PASTE_LEFT)
-                stream << "paste left";
-            if (token.flags & NAMED_OP)
-                stream << "named operator";
-            if (token.flags & NO_EXPAND)
-                stream << "no expansion";
-            if (token.flags & BOL)
-                stream << "beginning of line";
-            if (token.flags & PURE_ZERO)
-                stream << "pure zero";
-            if (token.flags & SP_DIGRAPH)
-                stream << "sp digraph";
-            if (token.flags & SP_PREV_WHITE)
-                stream << "sp previous whitespace";
-            stream.end_array ();
+        if (want (FIELD_TOKENS)) {
+            stream["tokens"_key].new_array ();
+            //unsigned int count = macro_real_token_count (macro); ???
+            for (unsigned int j = 0; j < macro->count; j++) {
+                cpp_token& token = macro->exp.tokens[j];
+
+                stream.new_object (true);
+                stream["kind"_key] << "gcc_macro_token";
+                stream["type"_key] << cpp_type2name (token.type, token.flags);
+
+                // Flags
+                if (want (FIELD_FLAGS)) {
+                    stream["flags"_key].new_array (true);
+                    if (token.flags & PREV_WHITE)
+                        stream << "previous whitespace";
+                    if (token.flags & DIGRAPH)
+                        stream << "digraph";
+                    if (token.flags & STRINGIFY_ARG)
+                        stream << "stringify";
+                    if (token.flags & PASTE_LEFT)
+                        stream << "paste left";
+                    if (token.flags & NAMED_OP)
+                        stream << "named operator";
+                    if (token.flags & NO_EXPAND)
+                        stream << "no expansion";
+                    if (token.flags & BOL)
+                        stream << "beginning of line";
+                    if (token.flags & PURE_ZERO)
+                        stream << "pure zero";
+                    if (token.flags & SP_DIGRAPH)
+                        stream << "sp digraph";
+                    if (token.flags & SP_PREV_WHITE)
+                        stream << "sp previous whitespace";
+                    stream.end_array ();
+                } // if
 
-            stream["text"];
-            if (token.type == CPP_MACRO_ARG)
-                stream << NODE_NAME (macro->params[token.val.macro_arg.arg_no - 1]);
-            else
-                stream << cpp_token_as_text (parse_in, &token);
+                stream["text"_key];
+                if (token.type == CPP_MACRO_ARG)
+                    print_name (stream, NODE_NAME (macro->params[token.val.macro_arg.arg_no - 1]));
+                else
+                    stream << cpp_token_as_text (parse_in, &token);
 
-            stream.end_object ();
-        } // for
-        stream.end_array ();
+                stream.end_object ();
+            } // for
+            stream.end_array ();
+        } // if
         stream.end_object ();
 
         return 1;
     } // print_macro
 
     static void
-    print_metadata (JSONStream& stream, plugin_gcc_version* version)
+    print_metadata (OutputStream& stream, plugin_gcc_version* version)
     {
-        stream["metadata"].new_object ();
-        stream["kind"] << "metadata_root";
-
-        stream["format"].new_object ();
-        stream["kind"] << "format_info";
-        stream["creator"] << "Treecreeper GCC plugin";
-        stream["version"] << "treecreeper-0";
+        ProfileScope scope (phase_profiles[PHASE_METADATA], &stream);
+        stream["metadata"_key].new_object ();
+        stream["kind"_key] << "metadata_root";
+
+        stream["format"_key].new_object ();
+        stream["kind"_key] << "format_info";
+        stream["creator"_key] << "Treecreeper GCC plugin";
+        stream["version"_key] << "treecreeper-0";
+        stream["records"_key] << options.records;
+        stream["layout"_key]
+            << (options.layout == Layout::Flat ? "flat" : "tree");
+        stream["ids"_key]
+            << (options.ids == IdFormat::Stable ? "stable" : "sequential");
+        stream["strings"_key]
+            << (options.strings == StringFormat::Table ? "table" : "inline");
+        stream["locations"_key]
+            << (options.locations == LocationFormat::Table ? "table" : "inline");
         stream.end_object ();
 
-        stream["compiler"].new_object ();
-        stream["kind"] << "comipler_info";
-        stream["name"] << "GCC";
-        stream["version"] << version->basever;
-        stream["revision"] << version->revision;
-        stream["build date"] << version->datestamp;
+        stream["compiler"_key].new_object ();
+        stream["kind"_key] << "comipler_info";
+        stream["name"_key] << "GCC";
+        stream["version"_key] << version->basever;
+        stream["revision"_key] << version->revision;
+        stream["build date"_key] << version->datestamp;
         stream.end_object ();
         stream.end_object ();
     } // print_metadata
 
     static void
-    print_namespace (JSONStream& stream, const_tree ns)
+    print_name (OutputStream& stream, const char* name)
+    {
+        if (!name || options.strings == StringFormat::Inline) {
+            stream << name;
+            return;
+        } // if
+
+        // Intern the name on its first use
+        auto result = string_indices.emplace (name, strings.size ());
+        if (result.second)
+            strings.push_back (name);
+        stream << result.first->second;
+    } // print_name
+
+    static void
+    print_namespace (OutputStream& stream, const_tree ns)
     {
         stream.new_object ();
         print_common_declaration (stream, ns);
 
         auto alias = DECL_NAMESPACE_ALIAS (ns);
-        stream["alias for"] << alias;
+        stream["alias for"_key] << alias;
 
-        if (!alias) {
+        // In records mode members are written as records of their own, and
+        // with roots only members reachable from the roots are written
+        if (!alias && !options.records && options.roots.empty ()) {
             // Harvest all declarations and order them by source location
             node_set decls;
 
             // Handle non-nmespace members first
             cp_binding_level* level = NAMESPACE_LEVEL (ns);
             for (const_tree decl = level->names; decl; decl = TREE_CHAIN (decl)) {
-                if (options.builtins || !DECL_IS_BUILTIN (decl)) {
+                if (!options.builtins && DECL_IS_BUILTIN (decl))
+                    continue;
+                if (is_filtered (decl))
+                    remember_const_decl (decl);
+                else {
                     remember_node (decl);
                     decls.insert (decl);
                 } // if
@@ -1082,39 +2001,67 @@ namespace treecreeper {
 
             // Process subnamespaces
             for (auto decl = level->namespaces; decl; decl = TREE_CHAIN (decl)) {
-                remember_node (decl);
-                decls.insert (decl);
+                if (!is_filtered (decl)) {
+                    remember_node (decl);
+                    decls.insert (decl);
+                } // if
             } // for
 
-            stream["declarations"].new_array ();
+            stream["declarations"_key].new_array ();
             for (auto decl : decls)
                 stream << decl;
             stream.end_array ();
-        } else
-            stream["declarations"] << Null;
+        } else if (alias)
+            stream["declarations"_key] << Null;
         stream.end_object ();
     } // print_namespace
 
     static void
-    print_pointer_type (JSONStream& stream, const_tree type)
+    print_node (OutputStream& stream, tree_printer_func func, const_tree node)
+    {
+        ProfileScope scope (printer_profiles[TREE_CODE (node)], &stream);
+
+        // Index file and namespace scope declarations and types
+        if (!index_stream || !is_file_scope (node)) {
+            func (stream, node);
+            return;
+        } // if
+
+        // Printers which only delegate or write an id open no block. Then
+        // the mark must not outlive start, and there is nothing to index.
+        const std::uint64_t no_block = UINT64_MAX;
+        std::uint64_t start = no_block;
+        stream.mark_next_block (&start);
+        func (stream, node);
+        stream.mark_next_block (nullptr);
+        if (start != no_block)
+            print_index_entry (node, start, stream.offset () - start);
+    } // print_node
+
+    static void
+    print_pointer_type (OutputStream& stream, const_tree type)
     {
         stream.new_object ();
         print_common_type (stream, type);
 
-        stream["referred type"] << TREE_TYPE (type);
-        if (TREE_CODE (type) == REFERENCE_TYPE)
-            stream["rvalue reference"] << bool (TYPE_REF_IS_RVALUE (type));
+        if (want (FIELD_TYPE))
+            stream["referred type"_key] << TREE_TYPE (type);
 
-        stream["member pointer"] << bool (TYPE_PTRDATAMEM_P (type));
-        if (TYPE_PTRDATAMEM_P (type)) {
-            stream["class type"] << TYPE_PTRMEM_CLASS_TYPE (type);
-            stream["member type"] << TYPE_PTRMEM_POINTED_TO_TYPE (type);
+        if (want (FIELD_ATTRIBUTES)) {
+            if (TREE_CODE (type) == REFERENCE_TYPE)
+                stream["rvalue reference"_key] << bool (TYPE_REF_IS_RVALUE (type));
+            stream["member pointer"_key] << bool (TYPE_PTRDATAMEM_P (type));
+        } // if
+
+        if (TYPE_PTRDATAMEM_P (type) && want (FIELD_TYPE)) {
+            stream["class type"_key] << TYPE_PTRMEM_CLASS_TYPE (type);
+            stream["member type"_key] << TYPE_PTRMEM_POINTED_TO_TYPE (type);
         } //if
         stream.end_object ();
     } // print_pointer_type
 
     static void
-    print_precisioned_type (JSONStream& stream, const_tree type)
+    print_precisioned_type (OutputStream& stream, const_tree type)
     {
         stream.new_object ();
         print_common_precision (stream, type);
@@ -1122,29 +2069,45 @@ namespace treecreeper {
     } // print_precisioned_type
 
     static void
-    print_real_constant (JSONStream& stream, const_tree cst)
+    print_real_constant (OutputStream& stream, const_tree cst)
     {
         stream.new_object ();
         print_common_constant (stream, cst);
 
-	REAL_VALUE_TYPE d;
-        stream["value"];
-	d = TREE_REAL_CST (cst);
-	if (REAL_VALUE_ISINF (d))
-            stream << (REAL_VALUE_NEGATIVE (d) ? "-Inf" : "Inf");
-	else if (REAL_VALUE_ISNAN (d))
-            stream << "Nan";
-        else {
-	    char str[100];
-	    real_to_decimal (str, &d, sizeof (str), 0, 1);
-	    stream << str;
-        } // if
-        stream["overflow"] << bool (TREE_OVERFLOW (cst));
+        if (want (FIELD_VALUES)) {
+            REAL_VALUE_TYPE d;
+            stream["value"_key];
+            d = TREE_REAL_CST (cst);
+            if (REAL_VALUE_ISINF (d))
+                stream << (REAL_VALUE_NEGATIVE (d) ? "-Inf" : "Inf");
+            else if (REAL_VALUE_ISNAN (d))
+                stream << "Nan";
+            else {
+                char str[100];
+                real_to_decimal (str, &d, sizeof (str), 0, 1);
+                stream << str;
+            } // if
+            stream["overflow"_key] << bool (TREE_OVERFLOW (cst));
+        } // if
         stream.end_object ();
     } // print_reaal_constant
 
     static void
-    print_record_type (JSONStream& stream, const_tree type)
+    print_record (const_tree node)
+    {
+        ProfileScope scope (phase_profiles[PHASE_RECORDS], record_stream.get ());
+        auto entry = nodes.find (node);
+        if (!entry || !entry->visited)
+            *record_stream << node;
+        else if (entry->incomplete && !is_incomplete (node)) {
+            // Print the finished node again with the same id
+            print_node (*record_stream, tree_printers.printers[TREE_CODE (node)], node);
+            nodes.get (node).incomplete = false;
+        } // if
+    } // print_record
+
+    static void
+    print_record_type (OutputStream& stream, const_tree type)
     {
         // Special case:record_type node may be actually a holder for a
         // pointer-to-member-function type. Handle this case separately from
@@ -1158,8 +2121,8 @@ namespace treecreeper {
         print_common_type (stream, type);
 
         const_tree base_info = TYPE_BINFO (type);
-        if (base_info) {
-            stream["base types"].new_array ();
+        if (base_info && want (FIELD_FIELDS)) {
+            stream["base types"_key].new_array ();
             const size_t num_bases = BINFO_N_BASE_BINFOS (base_info);
             bool has_access_infos = bool (BINFO_BASE_ACCESSES (base_info));
 
@@ -1167,9 +2130,9 @@ namespace treecreeper {
                 const_tree base = BINFO_BASE_BINFO (base_info, n);
 
                 stream.new_object ();
-                stream["type"] << BINFO_TYPE (base);
+                stream["type"_key] << BINFO_TYPE (base);
 
-                stream["access"];
+                stream["access"_key];
                 const_tree access;
                 if (has_access_infos)
                     access = BINFO_BASE_ACCESS (base_info, n);
@@ -1183,64 +2146,90 @@ namespace treecreeper {
                 else
                     stream << "public";
 
-                stream["virtual"] << bool (BINFO_VIRTUAL_P (base));
+                stream["virtual"_key] << bool (BINFO_VIRTUAL_P (base));
                 stream.end_object ();
             } // for
             stream.end_array ();
         } // if
 
         // Handle members
-        stream["fields"].new_array ();
-        for (tree field = TYPE_FIELDS (type); field; field = TREE_CHAIN (field))
-            stream << field;
-        stream.end_array ();
+        if (want (FIELD_FIELDS)) {
+            stream["fields"_key].new_array ();
+            for (tree field = TYPE_FIELDS (type); field; field = TREE_CHAIN (field))
+                stream << field;
+            stream.end_array ();
 
-        stream["methods"].new_array ();
-        for (tree method = TYPE_METHODS (type); method; method = TREE_CHAIN (method))
-            stream << method;
-        stream.end_array ();
+            stream["methods"_key].new_array ();
+            for (tree method = TYPE_METHODS (type); method; method = TREE_CHAIN (method))
+                stream << method;
+            stream.end_array ();
+        } // if
 
         stream.end_object ();
     } // print_record_type
 
     static void
-    print_reference (JSONStream& stream, const_tree node)
+    print_reference (OutputStream& stream, int id)
     {
         stream.new_object (true);
-        stream["kind"] << "reference";
-        stream["referred id"] << tree_id_map[node];
+        stream["kind"_key] << "reference";
+        stream["referred id"_key] << output_id (id);
         stream.end_object ();
     } // print_reference
 
     static void
-    print_root (JSONStream& stream, plugin_gcc_version* version)
+    print_root (OutputStream& stream, plugin_gcc_version* version)
     {
         stream.new_object ();
-        stream["kind"] << "root";
+        stream["kind"_key] << "root";
 
         // Put meta info in place
         print_metadata (stream, version);
 
-        stream["declarations"].new_array ();
-        print_all_translation_units (stream);
-        if (global_namespace)
-            stream << global_namespace;
-        stream.end_array ();
+        // File table is written before any locations which refer to it
+        if (options.locations == LocationFormat::Table
+            && (want (FIELD_LOCATION) || want (FIELD_INCLUDES))) {
+            build_file_table ();
+            print_file_table (stream["files"_key]);
+        } // if
 
-        // Make sure that we did not miss a single declaration
-        for (auto& elem : all_nodes) {
-            if (!visited_nodes.count (elem)) {
-                stream << elem;
+        {
+            ProfileScope scope (phase_profiles[PHASE_DECLARATIONS], &stream);
+            if (options.layout == Layout::Flat)
+                print_flat_layout (stream);
+            else if (!options.roots.empty ()) {
+                // Nodes reachable from the roots are printed with them
+                std::vector<const_tree> roots;
+                collect_roots (roots);
+                stream["declarations"_key].new_array ();
+                for (auto node : roots)
+                    stream << node;
+                stream.end_array ();
+            } else {
+                stream["declarations"_key].new_array ();
+                print_all_translation_units (stream);
+                if (global_namespace)
+                    stream << global_namespace;
+
+                // Make sure that we did not miss a single declaration
+                print_unvisited_nodes (stream);
+                stream.end_array ();
             } // if
-        } // for
+        }
 
-        print_all_macros (stream["macros"]);
-        print_all_line_maps (stream["includes"]);
+        if (want (FIELD_MACROS))
+            print_all_macros (stream["macros"_key]);
+        if (want (FIELD_INCLUDES))
+            print_all_line_maps (stream["includes"_key]);
+
+        // String table is complete only after everything else is written
+        if (options.strings == StringFormat::Table)
+            print_string_table (stream["strings"_key]);
         stream.end_object ();
     } // print_root
 
     static void
-    print_simple_type (JSONStream& stream, const_tree type)
+    print_simple_type (OutputStream& stream, const_tree type)
     {
         stream.new_object ();
         print_common_type (stream, type);
@@ -1248,65 +2237,203 @@ namespace treecreeper {
     } // print_simple_type
 
     static void
-    print_string_constant (JSONStream& stream, const_tree cst)
+    print_stats ()
+    {
+        // Printers are listed by tree code, most expensive first
+        std::vector<int> codes;
+        for (int code = 0; code < MAX_TREE_CODES; code++) {
+            if (printer_profiles[code].calls)
+                codes.push_back (code);
+        } // for
+        std::sort (codes.begin (), codes.end (), [] (int a, int b) {
+                return printer_profiles[a].self_seconds
+                    > printer_profiles[b].self_seconds;
+            });
+
+        auto stream = open_output_stream (options.stats_file.c_str (),
+                                          OutputFormat::JSON, Compression ());
+        auto& stats = *stream;
+        stats.new_object ();
+        stats["kind"_key] << "stats";
+        stats["output"_key] << options.output_file;
+        stats["nodes"_key] << nodes.size ();
+
+        stats["phases"_key].new_array ();
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            if (!phase_profiles[phase].calls)
+                continue;
+            stats.new_object (true);
+            stats["name"_key] << phase_names[phase];
+            print_profile_counter (stats, phase_profiles[phase]);
+            stats.end_object ();
+        } // for
+        stats.end_array ();
+
+        stats["printers"_key].new_array ();
+        for (int code : codes) {
+            stats.new_object (true);
+            stats["tree code"_key] << get_tree_code_name (tree_code (code));
+            print_profile_counter (stats, printer_profiles[code]);
+            stats.end_object ();
+        } // for
+        stats.end_array ();
+
+        const std::pair<const char*, const ProfileCounter*> functions[] = {
+            { "describe", &describe_profile },
+            { "print_macro", &macro_profile },
+            { "print_line_map", &line_map_profile }
+        };
+        stats["functions"_key].new_array ();
+        for (auto& function : functions) {
+            stats.new_object (true);
+            stats["name"_key] << function.first;
+            print_profile_counter (stats, *function.second);
+            stats.end_object ();
+        } // for
+        stats.end_array ();
+
+        stats.end_object ();
+        stats.close ();
+    } // print_stats
+
+    static void
+    print_string_constant (OutputStream& stream, const_tree cst)
     {
         stream.new_object ();
         print_common_constant (stream, cst);
-        stream["value"] << TREE_STRING_POINTER (cst);
+        if (want (FIELD_VALUES))
+            stream["value"_key] << TREE_STRING_POINTER (cst);
         stream.end_object ();
     } // print_string_constant
 
     static void
-    print_unsupported_node (JSONStream& stream, const_tree node)
+    print_string_table (OutputStream& stream)
     {
+        ProfileScope scope (phase_profiles[PHASE_STRINGS], &stream);
+        stream.new_array ();
+        for (auto name : strings)
+            stream << name;
+        stream.end_array ();
+    } // print_string_table
+
+    static void
+    print_unsupported_node (OutputStream& stream, const_tree node)
+    {
+        // Warn only once for each tree code, as C++ units may contain
+        // thousands of nodes of the same unsupported kind.
+        static bool warned[MAX_TREE_CODES];
+        auto code = TREE_CODE (node);
+        if (!warned[code]) {
+            warned[code] = true;
+            std::cerr << "treecreeper: Unsupported tree node "
+                      << get_tree_code_name (code)
+                      << ". Output will be incomplete.\n";
+        } // if
+        if (verbose (VERBOSE_DETAILS))
+            trace () << "treecreeper: Unsupported tree node " << node << "\n";
+
         stream.new_object ();
         print_common_tree (stream, node, false);
         stream.end_object ();
     } // print_unsupported_node
 
     static void
-    print_template_decl (JSONStream& stream, const_tree decl)
+    print_template_decl (OutputStream& stream, const_tree decl)
     {
         stream.new_object ();
         print_common_declaration (stream, decl);
 
-        stream["parameters"].new_array ();
-        auto& params = DECL_TEMPLATE_PARMS (decl);
-        for (auto& param = params; param; param = TREE_CHAIN (param)) {
-            stream.new_object ();
-            stream["level"] << TREE_INT_CST_LOW (TREE_PURPOSE (param));
-            stream["parameters"].new_array ();
-            auto vec = TREE_VALUE (param);
-            auto length = TREE_VEC_LENGTH (vec);
-            for (auto j = 0; j < length; j++) {
-                auto elt = TREE_VEC_ELT (vec, j);
+        if (want (FIELD_ARGUMENTS)) {
+            stream["parameters"_key].new_array ();
+            const_tree params = DECL_TEMPLATE_PARMS (decl);
+            for (const_tree param = params; param; param = TREE_CHAIN (param)) {
                 stream.new_object ();
-                stream["parameter"] << TREE_VALUE (elt);
-                stream["default"] << TREE_PURPOSE (elt);
+                stream["level"_key] << TREE_INT_CST_LOW (TREE_PURPOSE (param));
+                stream["parameters"_key].new_array ();
+                auto vec = TREE_VALUE (param);
+                auto length = TREE_VEC_LENGTH (vec);
+                for (auto j = 0; j < length; j++) {
+                    auto elt = TREE_VEC_ELT (vec, j);
+                    stream.new_object ();
+                    stream["parameter"_key] << TREE_VALUE (elt);
+                    stream["default"_key] << TREE_PURPOSE (elt);
+                    stream.end_object ();
+                } // for
+                stream.end_array ();
                 stream.end_object ();
             } // for
             stream.end_array ();
-            stream.end_object ();
-        } // for
-        stream.end_array ();
+        } // if
 
-        stream["result"] << DECL_TEMPLATE_RESULT (decl);
+        if (want (FIELD_TYPE))
+            stream["result"_key] << DECL_TEMPLATE_RESULT (decl);
         stream.end_object ();
     } // print_template_decl
 
     static void
-    print_translation_unit_decl (JSONStream& stream, const_tree decl)
+    print_trailer (OutputStream& stream)
+    {
+        stream.new_object ();
+        stream["kind"_key] << "trailer";
+
+        // Catch up with declarations which were not passed to the callbacks
+        {
+            ProfileScope scope (phase_profiles[PHASE_DECLARATIONS], &stream);
+            stream["declarations"_key].new_array ();
+            if (!options.roots.empty ()) {
+                std::vector<const_tree> roots;
+                collect_roots (roots);
+                for (auto node : roots) {
+                    auto entry = nodes.find (node);
+                    if (!entry || !entry->visited)
+                        stream << node;
+                } // for
+            } else {
+                print_all_translation_units (stream);
+                if (global_namespace) {
+                    remember_namespace_members (global_namespace);
+                    stream << global_namespace;
+                } // if
+                print_unvisited_nodes (stream);
+            } // if
+            stream.end_array ();
+        }
+
+        if (want (FIELD_MACROS))
+            print_all_macros (stream["macros"_key]);
+        if (want (FIELD_INCLUDES))
+            print_all_line_maps (stream["includes"_key]);
+
+        // Tables are complete only at the end of the unit
+        if (options.locations == LocationFormat::Table
+            && (want (FIELD_LOCATION) || want (FIELD_INCLUDES)))
+            print_file_table (stream["files"_key]);
+        if (options.strings == StringFormat::Table)
+            print_string_table (stream["strings"_key]);
+        stream.end_object ();
+    } // print_trailer
+
+    static void
+    print_translation_unit_decl (OutputStream& stream, const_tree decl)
     {
         stream.new_object ();
         print_common_declaration (stream, decl);
 
-        stream["language standard"] << TRANSLATION_UNIT_LANGUAGE (decl);
-        stream["blocks"] << DECL_INITIAL (decl);
+        if (want (FIELD_LANGUAGE))
+            stream["language standard"_key] << TRANSLATION_UNIT_LANGUAGE (decl);
+
+        // The file scope block holds every file scope declaration, so like
+        // namespaces the unit is written without them when roots are set
+        stream["blocks"_key];
+        if (options.roots.empty ())
+            stream << DECL_INITIAL (decl);
+        else
+            stream << Null;
         stream.end_object ();
     } // print_translation_unit
 
     static void
-    print_type_decl (JSONStream& stream, const_tree decl)
+    print_type_decl (OutputStream& stream, const_tree decl)
     {
         stream.new_object ();
         print_common_declaration (stream, decl);
@@ -1318,33 +2445,42 @@ namespace treecreeper {
             throw std::invalid_argument (err.str ());
         } // if
 
-        stream["type"] << type;
+        if (want (FIELD_TYPE))
+            stream["type"_key] << type;
         stream.end_object ();
     } // print_type_decl
 
     static void
-    print_var_decl (JSONStream& stream, const_tree decl)
+    print_var_decl (OutputStream& stream, const_tree decl)
     {
         int code = TREE_CODE (decl);
         stream.new_object ();
         print_common_declaration (stream, decl);
 
-        if (code == PARM_DECL) {
-            stream["type"] << TREE_TYPE (decl);
-            stream["passing type"] << DECL_ARG_TYPE (decl);
-        } else if (code == RESULT_DECL) {
-            stream["return type"] << TREE_TYPE (decl);
+        const bool types = want (FIELD_TYPE);
+        const bool attributes = want (FIELD_ATTRIBUTES);
+
+        if (code == PARM_DECL && types) {
+            stream["type"_key] << TREE_TYPE (decl);
+            stream["passing type"_key] << DECL_ARG_TYPE (decl);
+        } else if (code == RESULT_DECL && types) {
+            stream["return type"_key] << TREE_TYPE (decl);
         } else if (code == VAR_DECL) {
-            stream["type"] << TREE_TYPE (decl);
-            stream["thread local"] << bool (DECL_THREAD_LOCAL_P (decl));
-            stream["vtable"] << bool (DECL_VIRTUAL_P (decl));
+            if (types)
+                stream["type"_key] << TREE_TYPE (decl);
+            if (attributes) {
+                stream["thread local"_key] << bool (DECL_THREAD_LOCAL_P (decl));
+                stream["vtable"_key] << bool (DECL_VIRTUAL_P (decl));
+            } // if
         } else if (code == FIELD_DECL) {
-            stream["type"] << TREE_TYPE (decl);
-            stream["vtable pointer"] << bool (DECL_VIRTUAL_P (decl));
+            if (types)
+                stream["type"_key] << TREE_TYPE (decl);
+            if (attributes)
+                stream["vtable pointer"_key] << bool (DECL_VIRTUAL_P (decl));
         } // if
 
-        if (code == PARM_DECL || code == RESULT_DECL) {
-            stream["passing style"];
+        if ((code == PARM_DECL || code == RESULT_DECL) && attributes) {
+            stream["passing style"_key];
             if (DECL_BY_REFERENCE (decl))
                 stream << "reference";
             else
@@ -1355,27 +2491,47 @@ namespace treecreeper {
     } // print_var_decl
 
     static void
-    print_vector_constant (JSONStream& stream, const_tree cst)
+    print_unvisited_nodes (OutputStream& stream)
+    {
+        // Printing the remembered nodes may reveal new nodes, so repeat
+        // until there are none left.
+        std::vector<const_tree> pending;
+        for (collect_unvisited_nodes (pending); !pending.empty ();
+             collect_unvisited_nodes (pending)) {
+            for (auto node : pending) {
+                auto entry = nodes.find (node);
+                if (entry && !entry->visited)
+                    stream << node;
+            } // for
+        } // for
+    } // print_unvisited_nodes
+
+    static void
+    print_vector_constant (OutputStream& stream, const_tree cst)
     {
         stream.new_object ();
         print_common_constant (stream, cst);
 
-        stream["values"].new_array ();
-	for (unsigned int j = 0; j < VECTOR_CST_NELTS (cst); j++) {
-	    stream << VECTOR_CST_ELT (cst, j);
-        } // for
-        stream.end_array ();
+        if (want (FIELD_VALUES)) {
+            stream["values"_key].new_array ();
+            for (unsigned int j = 0; j < VECTOR_CST_NELTS (cst); j++) {
+                stream << VECTOR_CST_ELT (cst, j);
+            } // for
+            stream.end_array ();
+        } // if
         stream.end_object ();
     } // print_vector_constant
 
     static void
-    print_vector_type (JSONStream& stream, const_tree type)
+    print_vector_type (OutputStream& stream, const_tree type)
     {
         stream.new_object ();
         print_common_type (stream, type);
 
-        stream["element type"] << TREE_TYPE (type);
-        stream["element count"] << TYPE_PRECISION (type);
+        if (want (FIELD_TYPE))
+            stream["element type"_key] << TREE_TYPE (type);
+        if (want (FIELD_SIZE))
+            stream["element count"_key] << TYPE_PRECISION (type);
         stream.end_object ();
     } // print_vector_type
 
@@ -1395,9 +2551,9 @@ namespace treecreeper {
 
         auto klass = TREE_CODE_CLASS (TREE_CODE (node));
         if (klass == tcc_declaration)
-            loc = expand_location (DECL_SOURCE_LOCATION (node));
+            loc = resolve_location (DECL_SOURCE_LOCATION (node));
         else if (EXPR_HAS_LOCATION (node))
-            loc = expand_location (EXPR_LOCATION (node));
+            loc = resolve_location (EXPR_LOCATION (node));
 
         if (loc.file) {
             stream << " loc=" << loc.file << ":" << loc.line << ":" << loc.column;
@@ -1420,37 +2576,217 @@ namespace treecreeper {
         return stream;
     } // operator<<
 
+    static void
+    open_index ()
+    {
+        if (options.index_file.empty ())
+            return;
+
+        // Index is written as one JSON object per line, starting with a
+        // description of the indexed file.
+        index_stream = open_output_stream (options.index_file.c_str (),
+                                           OutputFormat::JSON, Compression (),
+                                           true);
+        auto& index = *index_stream;
+        index.new_object ();
+        index["kind"_key] << "index";
+        index["output"_key] << options.output_file;
+        index["format"_key]
+            << (options.format == OutputFormat::CBOR ? "cbor" : "json");
+        index["compressed"_key]
+            << (options.compression.method != CompressionMethod::None);
+        index.end_object ();
+    } // open_index
+
+    static std::uint64_t
+    output_id (unsigned int id)
+    {
+        // Nodes are counted internally in any case
+        if (options.ids == IdFormat::Stable)
+            return stable_ids[id];
+        return id;
+    } // output_id
+
+    void
+    open_records (plugin_gcc_version* version)
+    {
+        if (verbose (VERBOSE_PHASES))
+            trace () << "treecreeper: Writing records to " << options.output_file << "\n";
+
+        record_stream = open_output_stream (options.output_file.c_str (),
+                                            options.format, options.compression,
+                                            true);
+        record_stream->new_object ();
+        (*record_stream)["kind"_key] << "header";
+        print_metadata (*record_stream, version);
+        record_stream->end_object ();
+        open_index ();
+    } // open_records
+
     void
     print_whole_tree (plugin_gcc_version* version)
     {
-        if (errorcount || sorrycount) {
-            std::cerr << "Treecreeper: Errors occured while compiling, will not write output.\n";
-            return;
+        if (options.records) {
+            // Records are already written, so finish the file anyway
+            if (errorcount || sorrycount)
+                std::cerr << "Treecreeper: Errors occured while compiling, output is incomplete.\n";
+            print_trailer (*record_stream);
+            record_stream->close ();
+            record_stream.reset ();
+            close_index ();
+        } else {
+            if (errorcount || sorrycount) {
+                std::cerr << "Treecreeper: Errors occured while compiling, will not write output.\n";
+                return;
+            } // if
+
+            if (verbose (VERBOSE_PHASES))
+                trace () << "treecreeper: Writing " << options.output_file << "\n";
+
+            auto stream = open_output_stream (options.output_file.c_str (),
+                                              options.format, options.compression);
+            open_index ();
+            print_root (*stream, version);
+            stream->close ();
+            close_index ();
+        } // if
+
+        if (profiling ()) {
+            if (verbose (VERBOSE_PHASES))
+                trace () << "treecreeper: Writing stats to " << options.stats_file << "\n";
+            print_stats ();
         } // if
 
-        JSONStream stream (options.output_file.c_str ());
-        print_root (stream, version);
-        stream.close ();
+        if (verbose (VERBOSE_PHASES))
+            trace () << "treecreeper: Wrote " << nodes.size () << " nodes\n";
+        flush_trace ();
     } // print_whole_tree
 
+    static std::string
+    qualified_name (const_tree node)
+    {
+        const char* name = get_tree_name_ptr (node);
+        if (!name)
+            return std::string ();
+
+        // Prepend the names of enclosing namespaces
+        std::string result = name;
+        const_tree context = DECL_P (node) ? DECL_CONTEXT (node) : TYPE_CONTEXT (node);
+        while (context && TREE_CODE (context) == NAMESPACE_DECL
+               && context != global_namespace) {
+            const char* context_name = get_tree_name_ptr (context);
+            if (!context_name || !std::strcmp (context_name, "_GLOBAL__N_1"))
+                context_name = "(anonymous namespace)";
+            result.insert (0, "::").insert (0, context_name);
+            context = DECL_CONTEXT (context);
+        } // while
+        return result;
+    } // qualified_name
+
+    static void
+    remember_const_decl (const_tree node)
+    {
+        // Collect CONST_DECL nodes, see print_enumeral_type for details.
+        // This is done for filtered nodes too, as their enumeration types
+        // may be printed anyway.
+        if (TREE_CODE (node) == CONST_DECL)
+            const_decl_nodes.insert (std::make_pair (TREE_TYPE (node), node));
+    } // remember_const_decl
+
+    static void
+    remember_namespace_members (const_tree ns)
+    {
+        cp_binding_level* level = NAMESPACE_LEVEL (ns);
+        for (const_tree decl = level->names; decl; decl = TREE_CHAIN (decl)) {
+            if (!options.builtins && DECL_IS_BUILTIN (decl))
+                continue;
+            if (is_filtered (decl))
+                remember_const_decl (decl);
+            else
+                remember_node (decl);
+        } // for
+
+        for (auto decl = level->namespaces; decl; decl = TREE_CHAIN (decl)) {
+            if (is_filtered (decl))
+                continue;
+            remember_node (decl);
+            if (!DECL_NAMESPACE_ALIAS (decl))
+                remember_namespace_members (decl);
+        } // for
+    } // remember_namespace_members
+
     static void
     remember_node (const_tree node)
     {
         if (!node)
             return;
 
-        all_nodes.insert (node);
-        // Collect CONST_DECL nodes, see print_enumeral_type for details.
-        if (TREE_CODE (node) == CONST_DECL) {
-            const_decl_nodes.insert (std::make_pair (TREE_TYPE (node), node));
-        } // if
+        // Remember the location of declarations for print_unvisited_nodes
+        auto& entry = nodes.get (node);
+        if (TREE_CODE_CLASS (TREE_CODE (node)) == tcc_declaration)
+            entry.location = DECL_SOURCE_LOCATION (node);
+        remember_const_decl (node);
     } // remember_node
 
+    bool
+    parse_fields (const char* spec)
+    {
+        // Spec is a comma separated list of field group names
+        unsigned int fields = 0;
+        while (*spec) {
+            const char* end = std::strchr (spec, ',');
+            size_t length = end ? end - spec : std::strlen (spec);
+
+            bool found = false;
+            for (auto& field : field_names) {
+                if (std::strlen (field.first) == length
+                    && !std::strncmp (field.first, spec, length)) {
+                    fields |= field.second;
+                    found = true;
+                    break;
+                } // if
+            } // for
+
+            if (!found)
+                return false;
+            spec += end ? length + 1 : length;
+        } // while
+
+        options.fields = fields;
+        return true;
+    } // parse_fields
+
     void
-    visit_tree (const_tree node)
+    visit_tree (const_tree node, const char* phase)
     {
-        std::cout << "Visiting " << node << std::endl;
+        if (verbose (VERBOSE_DETAILS)) {
+            trace () << phase << ": Visiting " << node << "\n";
+        } else if (verbose (VERBOSE_NODES) && node) {
+            const char* name = get_tree_name_ptr (node);
+            trace () << phase << ": Visiting "
+                     << get_tree_code_name (TREE_CODE (node)) << " "
+                     << (name ? name : "<anonymous>") << "\n";
+        } // if
+
+        // Filtered declarations are only printed if a kept node refers to
+        // them
+        if (node && is_file_scope (node) && is_filtered (node)) {
+            remember_const_decl (node);
+            return;
+        } // if
         remember_node (node);
+
+        // Write file and namespace scope declarations and types right away
+        if (options.records && node && is_file_scope (node)
+            && (options.roots.empty () || is_root (node))
+            && (options.builtins || !DECL_P (node) || !DECL_IS_BUILTIN (node)))
+            print_record (node);
     } // visit_tree
 
+    static inline bool
+    want (unsigned int field)
+    {
+        return options.fields & field;
+    } // want
+
 } // namespace treecreeper
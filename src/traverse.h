@@ -4,23 +4,101 @@
 #define TRAVERSE_H
 
 #include <string>
+#include <vector>
 
 #include "gcc-plugin.h"
 #include "tree.h"
 
+#include "output_stream.h"
+
 struct plugin_gcc_version;
 
 namespace treecreeper {
 
+    // Groups of optional fields in the output. Fields which are not selected
+    // with the fields plugin argument are neither computed nor written.
+    enum Field : unsigned int {
+        FIELD_NAME = 1u << 0,
+        FIELD_DESCRIPTION = 1u << 1,
+        FIELD_LOCATION = 1u << 2,
+        FIELD_CONTEXT = 1u << 3,
+        FIELD_TYPE = 1u << 4,
+        FIELD_FIELDS = 1u << 5,
+        FIELD_ARGUMENTS = 1u << 6,
+        FIELD_VALUES = 1u << 7,
+        FIELD_SIZE = 1u << 8,
+        FIELD_QUALIFIERS = 1u << 9,
+        FIELD_ACCESS = 1u << 10,
+        FIELD_VISIBILITY = 1u << 11,
+        FIELD_ATTRIBUTES = 1u << 12,
+        FIELD_LANGUAGE = 1u << 13,
+        FIELD_FLAGS = 1u << 14,
+        FIELD_TOKENS = 1u << 15,
+        FIELD_MACROS = 1u << 16,
+        FIELD_INCLUDES = 1u << 17,
+        FIELD_ALL = ~0u
+    };
+
+    // How source locations are written
+    enum class LocationFormat {
+        Table,      // [file index, line, column] referring to the file table
+        Inline      // Objects with the file name
+    };
+
+    // How identifier names are written
+    enum class StringFormat {
+        Inline,     // As strings
+        Table       // As indices of the string table
+    };
+
+    // How nodes are arranged in the output
+    enum class Layout {
+        Tree,       // Nodes are nested where they are first referred to
+        Flat        // Nodes are listed by id and referred to by id
+    };
+
+    // How node ids are made
+    enum class IdFormat {
+        Sequential, // Counted in the order nodes are reached
+        Stable      // Hashed from the content of the node
+    };
+
     struct OPTIONS {
         std::string output_file;
+        OutputFormat format;
+        Compression compression;
         bool builtins;
+        bool records;
+        std::string index_file;
+        std::string stats_file;     // Profile of the printers, if not empty
+        unsigned int fields;
+        LocationFormat locations;
+        StringFormat strings;
+        Layout layout;
+        IdFormat ids;
+
+        // Filters of file and namespace scope declarations, macros and
+        // includes. Patterns are fnmatch globs on file names and qualified
+        // namespace names.
+        std::vector<std::string> include_files;
+        std::vector<std::string> exclude_files;
+        std::vector<std::string> include_namespaces;
+        std::vector<std::string> exclude_namespaces;
+        bool system_headers;
+
+        // Globs on qualified names of the declarations to start from. When
+        // set, only what is reachable from them is written.
+        std::vector<std::string> roots;
+
+        int verbose;
     };
 
     extern OPTIONS options;
 
+    void open_records (plugin_gcc_version* version);
+    bool parse_fields (const char* spec);
     void print_whole_tree (plugin_gcc_version* version);
-    void visit_tree (const_tree tree);
+    void visit_tree (const_tree tree, const char* phase);
 
 } // namespace treecreeper
 